@@ -0,0 +1,171 @@
+/**
+ * @file bench_qcustomlog.cpp
+ * @brief QCustomLog benchmarks
+ * @details Compares the log file writers at several message sizes, the text and JSON Lines formats including their writes,
+ *          and the flush and sync latency with and without preallocation of log files,
+ *          every case reports the heap allocations per message of the library
+ * @details Every case runs in its own process, because the logging settings are applied by initLogging() once per process
+ *
+ * @details This code is released under the MIT license
+ * @copyright (c) 2025 Dmitrii Permiakov [nebster9k]
+ *
+ * @see qcustomlog.h
+ */
+
+#include <cerrno>
+#include <cstdio>
+
+#include <qcustomlog.h>
+
+#include <QCommandLineParser>
+#include <QProcess>
+#include <QTemporaryDir>
+
+Q_LOGGING_CATEGORY(lcBench,"BENCH")
+
+static std::atomic<quint64> heapAllocations{0}; /**< Heap allocations of the process, counted only on glibc */
+
+#ifdef __GLIBC__
+   // the allocator of glibc is wrapped, Qt containers allocate with malloc() and operator new of libstdc++ calls it too,
+   // the aligned variants are wrapped as well, so an allocation cannot pass uncounted
+   extern "C" void* __libc_malloc(size_t size);
+   extern "C" void* __libc_calloc(size_t count, size_t size);
+   extern "C" void* __libc_realloc(void* ptr, size_t size);
+   extern "C" void* __libc_memalign(size_t alignment, size_t size);
+
+   extern "C" void* malloc(size_t size) noexcept { heapAllocations.fetch_add(1,std::memory_order_relaxed); return __libc_malloc(size); }
+   extern "C" void* calloc(size_t count, size_t size) noexcept { heapAllocations.fetch_add(1,std::memory_order_relaxed); return __libc_calloc(count,size); }
+   extern "C" void* realloc(void* ptr, size_t size) noexcept { heapAllocations.fetch_add(1,std::memory_order_relaxed); return __libc_realloc(ptr,size); }
+   extern "C" void* memalign(size_t alignment, size_t size) noexcept { heapAllocations.fetch_add(1,std::memory_order_relaxed); return __libc_memalign(alignment,size); }
+   extern "C" void* aligned_alloc(size_t alignment, size_t size) noexcept { heapAllocations.fetch_add(1,std::memory_order_relaxed); return __libc_memalign(alignment,size); }
+   extern "C" int posix_memalign(void** ptr, size_t alignment, size_t size) noexcept
+   {
+      if(alignment<sizeof(void*) || (alignment&(alignment-1))!=0) return EINVAL;
+      heapAllocations.fetch_add(1,std::memory_order_relaxed);
+      void* allocated=__libc_memalign(alignment,size);
+      if(!allocated && size>0) return ENOMEM;
+      *ptr=allocated; return 0;
+   }
+#endif
+
+static void discardMessage(QtMsgType, const QMessageLogContext&, const QString&) {} /**< Message handler of the baseline, only QDebug itself allocates */
+
+static int runCase(const QCommandLineParser& parser, const QString& logDir) /**< Logs the messages of one case and prints its results */
+{
+   const QString writer=parser.value("writer"), format=parser.value("format");
+   const int size=parser.value("size").toInt(), count=parser.value("count").toInt(), batch=parser.value("batch").toInt();
+   const bool unbuffered=parser.isSet("unbuffered");
+   const QString payload(size,QChar('x'));
+
+   auto logMessages=[&payload,batch](int messages)
+   {
+      for(int i=1;i<=messages;i++)
+      {
+         // a critical message flushes the buffer, so every batch is also written to the file
+         if(batch>0 && i%batch==0) qCCritical(lcBench).noquote() << payload;
+         else qCInfo(lcBench).noquote() << payload;
+      }
+   };
+
+   // QDebug allocates the message text before any handler, so its allocations are counted without the library and subtracted
+   QtMessageHandler previousHandler=qInstallMessageHandler(discardMessage);
+   logMessages(qMin(count,1000));
+   quint64 baseline=heapAllocations; logMessages(count); baseline=heapAllocations-baseline;
+   qInstallMessageHandler(previousHandler);
+
+   QCustomLog::setMinLevels(QtMsgType::QtFatalMsg,QtMsgType::QtDebugMsg); // only the file output is measured, the critical flushes do not reach the console
+   if(writer=="uring" && !QCustomLog::setIoUring(true)) { std::printf("unsupported\n"); return 0; }
+   QCustomLog::setFileFormat(format=="json" ? QCustomLog::FileFormat::JsonLines : QCustomLog::FileFormat::Text);
+   QCustomLog::setDeferredFormatting(parser.isSet("deferred"));
+   QCustomLog::setPreallocation(parser.isSet("preallocate"));
+   if(parser.isSet("sync")) QCustomLog::setDurability(QCustomLog::Durability::PeriodicSync,0,1); // every flush is synced
+   if(parser.isSet("clean") && !QCustomLog::addCleanCategory("BENCH","/dev/null",false)) { std::printf("unsupported\n"); return 0; }
+   if(!QCustomLog::initLogging(logDir,unbuffered ? 0 : 10000,10,64*1024*1024)) { std::printf("init failed\n"); return 1; }
+
+   // warm-up, so the arena and the per-thread formatting buffers have grown
+   logMessages(qMin(count,1000));
+
+   quint64 allocations=heapAllocations, growths=QCustomLog::bufferGrowths();
+   QElapsedTimer timer; timer.start();
+   logMessages(count);
+   qint64 elapsed=timer.nsecsElapsed();
+   allocations=heapAllocations-allocations; growths=QCustomLog::bufferGrowths()-growths;
+
+   #ifdef __GLIBC__
+      QByteArray allocationsText=QByteArray::number(((double)allocations-(double)baseline)/count,'f',2);
+   #else
+      QByteArray allocationsText="n/a";
+   #endif
+   std::printf("%10.0f %12.0f %10s %8llu %10.3f %10.3f\n",(double)elapsed/count,count*1e9/elapsed,allocationsText.constData(),
+               (unsigned long long)growths,QCustomLog::averageBufferFlushTime()*1e3,QCustomLog::averageSyncTime()*1e3);
+   return 0;
+}
+
+static int runAll(int count) /**< Runs every case in a child process and prints the results table */
+{
+   struct Case { QString title; QStringList arguments; int count; };
+   QList<Case> cases;
+
+   // one flush per message, so the writers are compared on the write path
+   for(const QString& writer:{QString("qfile"),QString("uring")})
+      for(int size:{64,256,1024,4096})
+         cases.append({"writer="+writer+" size="+QString::number(size),{"--writer",writer,"--size",QString::number(size),"--unbuffered"},count});
+
+   // one flush per 100 messages, so the formats are compared on the formatting and the write of their longer or shorter lines
+   for(const QString& format:{QString("text"),QString("json")})
+      for(int size:{64,1024})
+         cases.append({"format="+format+" size="+QString::number(size),{"--format",format,"--size",QString::number(size),"--batch","100"},count*5});
+
+   // a clean category written to /dev/null, so only the clean line encoding is left on the path
+   cases.append({"clean size=256",{"--size","256","--clean"},count*5});
+
+   // raw messages queued for the formatting thread, the allocations of both threads are counted
+   for(int size:{64,1024})
+      cases.append({"deferred size="+QString::number(size),{"--size",QString::number(size),"--deferred"},count*5});
+
+   // one flush per message, without and with a sync, so the block allocations and metadata updates of a growing file are included
+   for(bool sync:{false,true})
+      for(bool preallocate:{false,true})
+      {
+         QStringList arguments={"--size","256","--unbuffered"};
+         if(sync) arguments.append("--sync");
+         if(preallocate) arguments.append("--preallocate");
+         cases.append({QString("preallocate=")+(preallocate ? "on" : "off")+(sync ? " sync" : ""),arguments,sync ? qMax(count/10,1) : count});
+      }
+
+   std::printf("%-28s %10s %12s %10s %8s %10s %10s\n","case","ns/msg","msgs/s","allocs/msg","growths","flush ms","sync ms");
+   for(const Case& benchCase:std::as_const(cases))
+   {
+      QProcess process;
+      process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+      process.start(QCoreApplication::applicationFilePath(),QStringList({"--case","--count",QString::number(benchCase.count)})+benchCase.arguments);
+      if(!process.waitForFinished(-1) || process.exitCode()!=0) { std::printf("%-28s failed\n",qPrintable(benchCase.title)); continue; }
+      std::printf("%-28s %s",qPrintable(benchCase.title),process.readAllStandardOutput().constData());
+      std::fflush(stdout);
+   }
+   return 0;
+}
+
+int main(int argc, char* argv[])
+{
+   QTemporaryDir logDir; // outlives the application, so the flush on its shutdown still has the directory
+   QCoreApplication app(argc,argv);
+
+   QCommandLineParser parser;
+   parser.addHelpOption();
+   parser.addOption({"count","Messages per case, default is 20000","count","20000"});
+   parser.addOption({"case","Run a single case, used by the child processes"});
+   parser.addOption({"writer","Log file writer, qfile or uring","writer","qfile"});
+   parser.addOption({"format","Log file format, text or json","format","text"});
+   parser.addOption({"size","Message size in characters","size","256"});
+   parser.addOption({"batch","Log every n-th message as critical, which flushes the buffer","batch","0"});
+   parser.addOption({"unbuffered","Flush the buffer on every message"});
+   parser.addOption({"clean","Log to a clean category written to /dev/null"});
+   parser.addOption({"deferred","Format messages on the formatting thread"});
+   parser.addOption({"preallocate","Preallocate log files"});
+   parser.addOption({"sync","Sync the log file on every flush"});
+   parser.process(app);
+
+   if(parser.isSet("case")) return runCase(parser,logDir.path());
+   return runAll(qMax(parser.value("count").toInt(),1));
+}
@@ -13,222 +13,1975 @@
 
 #include <qcustomlog.h>
 
+#ifdef Q_OS_WIN
+   #include <windows.h>
+   #include <io.h>
+#else
+   #include <unistd.h>
+   #include <fcntl.h>
+   #include <csignal>
+#endif
+
+#ifdef __GLIBC__
+   #include <execinfo.h>
+#endif
+
+#ifdef QCUSTOMLOG_IO_URING
+   #include <liburing.h>
+#endif
+
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <chrono>
+#include <cmath>
+
+#include <QLocale>
+#include <QSettings>
+#include <QFileInfo>
+#include <QRandomGenerator>
+
+static qint64 currentTimeNs() /**< Current time in nanoseconds since the epoch */
+{
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static qint64 monotonicTimeNs() /**< Monotonic time in nanoseconds for intervals, unaffected by wall clock steps */
+{
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void writeAll(int fd, const char* data, qint64 size) /**< Writes the whole data to the file descriptor, async-signal-safe on POSIX */
+{
+   while(size>0)
+   {
+      #ifdef Q_OS_WIN
+         int written=_write(fd,data,(unsigned int)qMin(size,(qint64)(1024*1024*1024)));
+      #else
+         ssize_t written=write(fd,data,size);
+         if(written<0 && errno==EINTR) continue;
+      #endif
+      if(written<=0) return;
+      data+=written; size-=written;
+   }
+}
+
+static QDateTime dateTimeFromNs(qint64 timeNs, bool utcMode) /**< Converts the time in nanoseconds since the epoch to local or UTC time */
+{
+   QDateTime time=QDateTime::fromMSecsSinceEpoch(timeNs/1000000);
+   return utcMode ? time.toUTC() : time;
+}
+
+static char* encodeUtf8(char* dst, const QChar* src, qsizetype size) /**< Encodes UTF-16 to UTF-8, the destination must fit 3 bytes per code unit, returns the end */
+{
+   for(qsizetype i=0;i<size;i++)
+   {
+      uint c=src[i].unicode();
+      if(c<0x80) *dst++=(char)c;
+      else if(c<0x800) { *dst++=(char)(0xC0|(c>>6)); *dst++=(char)(0x80|(c&0x3F)); }
+      else if(c>=0xD800 && c<0xDC00 && i+1<size && src[i+1].unicode()>=0xDC00 && src[i+1].unicode()<0xE000)
+      {
+         c=0x10000+((c-0xD800)<<10)+(src[++i].unicode()-0xDC00);
+         *dst++=(char)(0xF0|(c>>18)); *dst++=(char)(0x80|((c>>12)&0x3F)); *dst++=(char)(0x80|((c>>6)&0x3F)); *dst++=(char)(0x80|(c&0x3F));
+      }
+      else
+      {
+         if(c>=0xD800 && c<0xE000) c=0xFFFD; // unpaired surrogate
+         *dst++=(char)(0xE0|(c>>12)); *dst++=(char)(0x80|((c>>6)&0x3F)); *dst++=(char)(0x80|(c&0x3F));
+      }
+   }
+   return dst;
+}
+
+static void appendUtf8(QByteArray& out, const QString& string) /**< Appends the string encoded as UTF-8 without a temporary array */
+{
+   qsizetype start=out.size();
+   out.resize(start+string.size()*3); // the worst case of UTF-16 code units
+   out.resize(encodeUtf8(out.data()+start,string.constData(),string.size())-out.constData());
+}
+
+static void appendJsonString(QByteArray& out, const QString& string) /**< Appends a quoted and escaped JSON string encoded as UTF-8 without a temporary array */
+{
+   static const char hex[]="0123456789abcdef";
+   const QChar* src=string.constData(); qsizetype size=string.size();
+
+   qsizetype start=out.size();
+   out.resize(start+2+size*6); // the worst case of an escaped control character
+   char* dst=out.data()+start;
+   *dst++='"';
+   for(qsizetype i=0;i<size;i++)
+   {
+      uint c=src[i].unicode();
+      if(c>=0x80)
+      {
+         // UTF-8 multibyte sequences are valid JSON as is, a whole run is encoded at once to keep surrogate pairs together
+         qsizetype end=i+1; while(end<size && src[end].unicode()>=0x80) end++;
+         dst=encodeUtf8(dst,src+i,end-i); i=end-1;
+         continue;
+      }
+      switch(c)
+      {
+         case '"': *dst++='\\'; *dst++='"'; break;
+         case '\\': *dst++='\\'; *dst++='\\'; break;
+         case '\n': *dst++='\\'; *dst++='n'; break;
+         case '\r': *dst++='\\'; *dst++='r'; break;
+         case '\t': *dst++='\\'; *dst++='t'; break;
+         default:
+            if(c<0x20) { memcpy(dst,"\\u00",4); dst+=4; *dst++=hex[(c>>4)&0xF]; *dst++=hex[c&0xF]; }
+            else *dst++=(char)c;
+      }
+   }
+   *dst++='"';
+   out.resize(dst-out.constData());
+}
+
+static void appendNumber(QByteArray& out, quint64 value) /**< Appends a decimal number without a temporary array */
+{
+   char digits[20]; int count=0;
+   do { digits[count++]=(char)('0'+value%10); value/=10; } while(value>0);
+   while(count>0) out.append(digits[--count]);
+}
+
+static void writeMilliseconds(char* dst, int ms) /**< Writes three milliseconds digits */
+{
+   dst[0]=(char)('0'+ms/100); dst[1]=(char)('0'+ms/10%10); dst[2]=(char)('0'+ms%10);
+}
+
+static void writeMilliseconds(QChar* dst, int ms) /**< Writes three milliseconds digits */
+{
+   char digits[3]; writeMilliseconds(digits,ms);
+   dst[0]=QLatin1Char(digits[0]); dst[1]=QLatin1Char(digits[1]); dst[2]=QLatin1Char(digits[2]);
+}
+
+static qsizetype millisecondsField(const QString& format) /**< Returns the position of the three-digit milliseconds field of a date format, -1 without sub-second fields, -2 with other ones */
+{
+   qsizetype position=-1; bool quoted=false;
+   for(qsizetype i=0;i<format.size();i++)
+   {
+      QChar c=format.at(i);
+      if(c==QLatin1Char('\'')) { quoted=!quoted; continue; } // two quotes are a literal quote and toggle twice
+      if(quoted || c!=QLatin1Char('z')) continue;
+
+      qsizetype end=i; while(end<format.size() && format.at(end)==QLatin1Char('z')) end++;
+      if(end-i!=3 || position>=0) return -2;
+      position=i; i=end-1;
+   }
+   return position;
+}
+
+void QCustomLogField::appendText(QString& out, const QList<QCustomLogField>& fields)
+{
+   for(const QCustomLogField& field:fields)
+   {
+      if(!out.isEmpty()) out.append(' ');
+      out.append(QString::fromUtf8(field.key)).append('=');
+      switch(field.type)
+      {
+         case Type::Int: out.append(QString::number(field.intValue)); break;
+         case Type::UInt: out.append(QString::number(field.uintValue)); break;
+         case Type::Double: out.append(QString::number(field.doubleValue,'g',QLocale::FloatingPointShortest)); break;
+         case Type::Bool: out.append(field.boolValue ? "true" : "false"); break;
+         default: // Type::String
+            if(field.stringValue.isEmpty() || field.stringValue.contains(' ') || field.stringValue.contains('"') || field.stringValue.contains('='))
+            {
+               QString escaped=field.stringValue; escaped.replace("\\","\\\\").replace("\"","\\\"");
+               out.append('"').append(escaped).append('"');
+            } else out.append(field.stringValue);
+            break;
+      }
+   }
+}
+
+void QCustomLogField::appendJson(QByteArray& out, const QList<QCustomLogField>& fields)
+{
+   for(const QCustomLogField& field:fields)
+   {
+      out.append(',');
+      appendJsonString(out,QString::fromUtf8(field.key));
+      out.append(':');
+      switch(field.type)
+      {
+         case Type::Int: out.append(QByteArray::number(field.intValue)); break;
+         case Type::UInt: out.append(QByteArray::number(field.uintValue)); break;
+         case Type::Double:
+            if(std::isfinite(field.doubleValue)) out.append(QByteArray::number(field.doubleValue,'g',QLocale::FloatingPointShortest));
+            else out.append("null"); // JSON has no infinity and NaN
+            break;
+         case Type::Bool: out.append(field.boolValue ? "true" : "false"); break;
+         default: appendJsonString(out,field.stringValue); break; // Type::String
+      }
+   }
+}
+
+void QCustomLogField::appendBinary(QByteArray& out, const QList<QCustomLogField>& fields)
+{
+   auto appendInteger=[&out](quint64 value, int size) { for(int i=0;i<size;i++) out.append((char)((value>>(i*8))&0xFF)); };
+
+   appendInteger(qMin((qsizetype)fields.count(),(qsizetype)0xFFFF),2);
+   for(qsizetype i=0;i<fields.count() && i<0xFFFF;i++)
+   {
+      const QCustomLogField& field=fields.at(i);
+      quint8 keySize=qMin((size_t)qstrlen(field.key),(size_t)0xFF);
+      out.append((char)keySize); out.append(field.key,keySize);
+      out.append((char)field.type);
+      switch(field.type)
+      {
+         case Type::Int: appendInteger((quint64)field.intValue,8); break;
+         case Type::UInt: appendInteger(field.uintValue,8); break;
+         case Type::Double: { quint64 bits; memcpy(&bits,&field.doubleValue,8); appendInteger(bits,8); } break;
+         case Type::Bool: appendInteger(field.boolValue ? 1 : 0,8); break;
+         default: // Type::String
+         {
+            QByteArray utf8=field.stringValue.toUtf8();
+            appendInteger(utf8.size(),4); out.append(utf8);
+            break;
+         }
+      }
+   }
+}
+
+QCustomLogFieldsScope::QCustomLogFieldsScope(std::initializer_list<QCustomLogField> fields) : m_fields(fields), m_previous(QCustomLog::m_threadFields)
+{
+   QCustomLog::m_threadFields=&m_fields;
+}
+
+QCustomLogFieldsScope::~QCustomLogFieldsScope()
+{
+   QCustomLog::m_threadFields=m_previous;
+}
+
+void QCustomLogSink::setFilter(QtMsgType minLevel, const QStringList& categories)
+{
+   QCustomLog::m_sinksLock.lockForWrite();
+   m_minLevel=minLevel; m_categories=categories;
+   QCustomLog::m_routesGeneration++;
+   QCustomLog::m_sinksLock.unlock();
+}
+
+void QCustomLogSink::fillSlot(Slot& slot, qint64 time, QtMsgType type, const QString& category, const QString& message, const QList<QCustomLogField>* fields,
+                              quintptr threadId)
+{
+   slot.time=time; slot.type=type; slot.threadId=threadId;
+   slot.category=category;
+   slot.fields=fields ? *fields : QList<QCustomLogField>();
+
+   // a UTF-16 code unit takes up to 3 bytes, so longer messages can never fit
+   if(message.size()<=(qsizetype)sizeof(slot.text))
+   {
+      char utf8[3*sizeof(slot.text)];
+      qsizetype size=encodeUtf8(utf8,message.constData(),message.size())-utf8;
+      if(size<=(qsizetype)sizeof(slot.text))
+      {
+         memcpy(slot.text,utf8,size); slot.size=(quint16)size;
+         slot.overflow=QString();
+         return;
+      }
+   }
+   slot.size=0; slot.overflow=message;
+}
+
+void QCustomLogSink::start()
+{
+   m_queueMutex.lock();
+   if(!m_worker)
+   {
+      if(m_slots.isEmpty()) m_slots.resize(m_queueSize);
+      m_stopping=false;
+      m_worker=QThread::create([this]() { run(); });
+      m_worker->start();
+   }
+   m_queueMutex.unlock();
+}
+
+QCustomLogSink::~QCustomLogSink()
+{
+   // the derived part is already destroyed, so writeRecords() must not be called anymore
+   m_queueMutex.lock(); bool running=(m_worker!=nullptr); m_queueMutex.unlock();
+   Q_ASSERT_X(!running,"QCustomLogSink","Remove the sink with QCustomLog::removeSink() before destroying it");
+   if(!running) return;
+
+   QCustomLog::m_sinksLock.lockForWrite();
+   if(QCustomLog::m_sinks.removeOne(this)) QCustomLog::m_routesGeneration++;
+   QCustomLog::m_sinksLock.unlock();
+
+   m_queueMutex.lock(); m_discarding=true; m_queueMutex.unlock();
+   stop();
+}
+
+void QCustomLogSink::stop()
+{
+   m_queueMutex.lock();
+   QThread* worker=m_worker; m_worker=nullptr;
+   m_stopping=true;
+   m_queueCondition.wakeAll();
+   m_queueMutex.unlock();
+
+   if(worker) { worker->wait(); delete worker; }
+}
+
+void QCustomLogSink::enqueue(const Slot& slot)
+{
+   m_queueMutex.lock();
+   if(m_count>=m_queueSize || m_stopping || m_slots.isEmpty()) { m_queueMutex.unlock(); m_droppedRecords++; return; }
+   m_slots[(m_head+m_count)%m_queueSize]=slot; m_count++;
+   m_queueCondition.wakeOne();
+   m_queueMutex.unlock();
+}
+
+void QCustomLogSink::run()
+{
+   QList<QCustomLogRecord> batch; batch.reserve(m_maxBatchSize);
+   QVector<Slot> taken(m_maxBatchSize);
+
+   m_queueMutex.lock();
+   while(true)
+   {
+      while(m_count==0 && !m_stopping) m_queueCondition.wait(&m_queueMutex);
+      if(m_count==0 || m_discarding) break; // stopping and all records are written, or the sink is being destroyed
+
+      // slots are swapped with the empty ones, so the strings are converted and freed here instead of under the lock
+      quint32 count=0;
+      while(m_count>0 && count<m_maxBatchSize) { std::swap(taken[count++],m_slots[m_head]); m_head=(m_head+1)%m_queueSize; m_count--; }
+      m_queueMutex.unlock();
+
+      for(quint32 i=0;i<count;i++)
+      {
+         Slot& slot=taken[i];
+         batch.append({slot.time,slot.type,slot.category,slot.overflow.isNull() ? QString::fromUtf8(slot.text,slot.size) : slot.overflow,slot.threadId,slot.fields});
+         slot.category=QString(); slot.overflow=QString(); slot.fields=QList<QCustomLogField>();
+      }
+
+      writeRecords(batch);
+
+      // calculate EMA (Exponential Moving Average) of the oldest record latency in the batch with alpha=0.1
+      float latency=(float)(currentTimeNs()-batch.first().time)/1e9, latencyAvg=m_latency;
+      if(latencyAvg<=+0.0f) latencyAvg=latency; else latencyAvg=(latencyAvg*0.9f)+(latency*0.1f);
+      m_latency=latencyAvg;
+
+      batch.clear();
+      m_queueMutex.lock();
+   }
+   m_queueMutex.unlock();
+}
+
+bool QCustomLog::addSink(QCustomLogSink* sink)
+{
+   if(!sink || sink==&m_fileSink) return false;
+
+   m_sinksLock.lockForWrite();
+   if(!m_sinks.contains(sink))
+   {
+      if(m_sinks.count()>=63) { m_sinksLock.unlock(); return false; } // routes are 64-bit masks with the file sink
+      sink->start(); m_sinks.append(sink);
+      m_routesGeneration++;
+   }
+   m_sinksLock.unlock();
+   return true;
+}
+
+void QCustomLog::removeSink(QCustomLogSink* sink)
+{
+   m_sinksLock.lockForWrite();
+   bool removed=m_sinks.removeOne(sink);
+   if(removed) m_routesGeneration++; // bits of the following sinks are shifted
+   m_sinksLock.unlock();
+
+   if(removed) sink->stop(); // outside of the lock, so logging threads are not blocked while the queue is written
+}
+
+void QCustomLog::setMinLevels(QtMsgType outLevel, QtMsgType fileLevel)
+{
+   QCustomLog::updateConfig([outLevel,fileLevel](Config& config) { config.minOutLevel=outLevel; config.fileLevel=fileLevel; });
+}
+
 bool QCustomLog::setTimestampFormat(const QString& format)
 {
    if(format.isEmpty()) return false;
    if(!QDateTime::fromString(QDateTime::currentDateTime().toString(format),format).isValid()) return false;
 
-   m_logMessageFormat="'['"+format+"']'";
+   QString messageFormat="'['"+format+"']'";
+   QCustomLog::updateConfig([&messageFormat](Config& config) { config.logMessageFormat=messageFormat; });
+   return true;
+}
+
+void QCustomLog::setCleanLogCategory(const QString& category, bool writeToFile)
+{
+   QCustomLog::updateConfig([&category,writeToFile](Config& config) { QCustomLog::setConsoleCleanCategory(config,category,writeToFile); });
+}
+
+void QCustomLog::setConsoleCleanCategory(Config& config, const QString& category, bool writeToFile)
+{
+   for(auto it=config.cleanRoutes.begin();it!=config.cleanRoutes.end();) { if(it->fd<0) it=config.cleanRoutes.erase(it); else ++it; }
+   if(!category.isEmpty()) config.cleanRoutes.insert(category,{-1,writeToFile,QSharedPointer<QFile>()});
+}
+
+bool QCustomLog::addCleanCategory(const QString& category, const QString& outputFile, bool writeToFile)
+{
+   if(category.isEmpty()) return false;
+
+   QFile* file=nullptr;
+   if(!outputFile.isEmpty())
+   {
+      file=new QFile(outputFile);
+      if(!file->open(QFile::OpenModeFlag::WriteOnly|QFile::OpenModeFlag::Append))
+      {
+         QCustomLog::callErrorHandler("Clean log category file \""+outputFile+"\" open error: "+file->errorString());
+         delete file;
+         return false;
+      }
+      if(file->handle()<0) // written by descriptor, -1 would be taken for the standard output
+      {
+         QCustomLog::callErrorHandler("Clean log category file \""+outputFile+"\" has no file descriptor");
+         delete file;
+         return false;
+      }
+   }
+
+   QCustomLog::setCleanRoute(category,file ? file->handle() : -1,writeToFile,file);
+   return true;
+}
+
+bool QCustomLog::addCleanCategory(const QString& category, int fd, bool writeToFile)
+{
+   if(category.isEmpty() || fd<0) return false;
+   QCustomLog::setCleanRoute(category,fd,writeToFile,nullptr);
+   return true;
+}
+
+void QCustomLog::removeCleanCategory(const QString& category)
+{
+   QCustomLog::setCleanRoute(category,-2,false,nullptr);
+}
+
+void QCustomLog::setCleanRoute(const QString& category, int fd, bool toFile, QFile* file)
+{
+   // snapshots own the file, so it is closed when the last snapshot routing to it is retired, whatever replaced the route,
+   // and never while a message of an older snapshot may still write to its descriptor
+   QSharedPointer<QFile> owned(file);
+   QCustomLog::updateConfig([&category,fd,toFile,&owned](Config& config)
+   {
+      if(fd==-2) config.cleanRoutes.remove(category); else config.cleanRoutes.insert(category,{fd,toFile,owned});
+   });
+}
+
+bool QCustomLog::cleanRoute(const Config& config, CategoryInfo* category, int& fd, bool& toFile)
+{
+   // the generation and the route are cached in one atomic, so concurrent messages with different snapshots never mix them
+   quint64 generation=config.generation&0xFFFFFFFF, cached=category->cleanRoute;
+   if((cached>>32)!=generation)
+   {
+      auto it=config.cleanRoutes.constFind(category->name);
+      quint32 route=(it==config.cleanRoutes.constEnd()) ? 0 : ((quint32)(it->fd+2)<<1)|(it->toFile ? 1 : 0);
+      cached=(generation<<32)|route;
+      category->cleanRoute=cached;
+   }
+
+   quint32 route=(quint32)cached;
+   if(route==0) return false;
+   fd=(int)(route>>1)-2; toFile=(route&1);
+   return true;
+}
+
+void QCustomLog::cleanWrite(int fd, const QByteArray& line)
+{
+   m_cleanWriteMutex.lock();
+   writeAll(fd,line.constData(),line.size());
+   m_cleanWriteMutex.unlock();
+}
+
+void QCustomLog::setUtcMode(bool utcMode)
+{
+   QCustomLog::updateConfig([utcMode](Config& config) { config.utcMode=utcMode; });
+}
+
+void QCustomLog::setConsoleStream(ConsoleStream stream)
+{
+   QCustomLog::updateConfig([stream](Config& config) { config.consoleStream=stream; });
+}
+
+bool QCustomLog::watchConfigFile(const QString& path)
+{
+   if(m_configWatcher) { delete m_configWatcher; m_configWatcher=nullptr; }
+   m_configFilePath=path; m_configFileStamp={-1,-1};
+   if(path.isEmpty()) return true;
+
+   // the directory is watched too, since editors usually replace the file and its watch is lost
+   m_configWatcher=new QFileSystemWatcher();
+   m_configWatcher->addPath(QFileInfo(path).absolutePath());
+   if(QFileInfo(path).exists()) m_configWatcher->addPath(path);
+   QObject::connect(m_configWatcher,&QFileSystemWatcher::fileChanged,m_configWatcher,[](const QString&) { QCustomLog::configFileChanged(); });
+   QObject::connect(m_configWatcher,&QFileSystemWatcher::directoryChanged,m_configWatcher,[](const QString&) { QCustomLog::configFileChanged(); });
+
+   return QCustomLog::loadConfigFile();
+}
+
+void QCustomLog::configFileChanged()
+{
+   QFileInfo info(m_configFilePath);
+   if(!info.exists()) return; // in the middle of the replacement, the directory change follows
+   if(!m_configWatcher->files().contains(m_configFilePath)) m_configWatcher->addPath(m_configFilePath);
+
+   // other files of the directory also trigger changes
+   QPair<qint64,qint64> stamp={info.lastModified().toMSecsSinceEpoch(),info.size()};
+   if(stamp!=m_configFileStamp) QCustomLog::loadConfigFile();
+}
+
+bool QCustomLog::parseLevel(const QString& name, QtMsgType& level)
+{
+   QString lower=name.trimmed().toLower();
+   if(lower=="debug") level=QtMsgType::QtDebugMsg;
+   else if(lower=="info") level=QtMsgType::QtInfoMsg;
+   else if(lower=="warning") level=QtMsgType::QtWarningMsg;
+   else if(lower=="critical") level=QtMsgType::QtCriticalMsg;
+   else return false;
+   return true;
+}
+
+bool QCustomLog::loadConfigFile()
+{
+   QFileInfo info(m_configFilePath);
+   if(!info.exists())
+   {
+      QCustomLog::callErrorHandler("Config file does not exist");
+      return false;
+   }
+   m_configFileStamp={info.lastModified().toMSecsSinceEpoch(),info.size()};
+
+   QSettings settings(m_configFilePath,QSettings::IniFormat);
+   if(settings.status()!=QSettings::NoError)
+   {
+      QCustomLog::callErrorHandler("Config file has a format error");
+      return false;
+   }
+
+   // snapshot settings are parsed completely first and then published at once, missing keys keep the values of the current snapshot
+   QtMsgType outLevel=QtMsgType::QtDebugMsg, fileLevel=QtMsgType::QtDebugMsg;
+   QString format;
+   bool outLevelSet=false, fileLevelSet=false, formatSet=false, valid=true;
+
+   // keys of the INI [General] section are the root keys of QSettings, its "General" group would be a [%General] section
+   if(settings.contains("outputLevel")) { if(QCustomLog::parseLevel(settings.value("outputLevel").toString(),outLevel)) outLevelSet=true; else valid=false; }
+   if(settings.contains("fileLevel")) { if(QCustomLog::parseLevel(settings.value("fileLevel").toString(),fileLevel)) fileLevelSet=true; else valid=false; }
+   if(settings.contains("timestampFormat"))
+   {
+      format=settings.value("timestampFormat").toString();
+      if(!format.isEmpty() && QDateTime::fromString(QDateTime::currentDateTime().toString(format),format).isValid()) formatSet=true; else valid=false;
+   }
+   QVariant utc=settings.value("utc"), cleanCategory=settings.value("cleanCategory"), cleanToFile=settings.value("cleanToFile");
+
+   // allKeys() instead of childKeys(), QSettings takes "/" of category names like "CI/CD" for a subgroup separator
+   QHash<QString,double> sampling;
+   settings.beginGroup("Sampling");
+   for(const QString& key : settings.allKeys())
+   {
+      bool ok=false; double rate=settings.value(key).toDouble(&ok);
+      if(ok) sampling.insert((key=="default") ? QString() : key,rate); else valid=false;
+   }
+   settings.endGroup();
+
+   QHash<QString,quint32> rateLimits;
+   settings.beginGroup("RateLimit");
+   for(const QString& key : settings.allKeys())
+   {
+      bool ok=false; quint32 rate=settings.value(key).toUInt(&ok);
+      if(ok) rateLimits.insert(key,rate); else valid=false;
+   }
+   settings.endGroup();
+
+   // rules of the code are kept until the file has its own ones
+   bool rulesSet=(settings.childGroups().contains("Categories") || m_configFileRules);
+   QStringList rules; QHash<QString,int> compiledRules;
+   if(rulesSet)
+   {
+      settings.beginGroup("Categories");
+      for(const QString& key : settings.allKeys()) rules.append(key+"="+settings.value(key).toString());
+      settings.endGroup();
+      if(!QCustomLog::compileCategoryRules(rules.join(';'),compiledRules)) valid=false;
+   }
+
+   // the whole file is one snapshot, categories removed from the file are reset, so the file fully describes the categories it manages
+   QCustomLog::updateConfig([&](Config& config)
+   {
+      if(outLevelSet) config.minOutLevel=outLevel;
+      if(fileLevelSet) config.fileLevel=fileLevel;
+      if(formatSet) config.logMessageFormat="'['"+format+"']'";
+      if(utc.isValid()) config.utcMode=utc.toBool();
+      if(cleanCategory.isValid() || cleanToFile.isValid())
+      {
+         QString category; bool toFile=true;
+         for(auto it=config.cleanRoutes.constBegin();it!=config.cleanRoutes.constEnd();++it) if(it->fd<0) { category=it.key(); toFile=it->toFile; }
+         QCustomLog::setConsoleCleanCategory(config,cleanCategory.isValid() ? cleanCategory.toString() : category,cleanToFile.isValid() ? cleanToFile.toBool() : toFile);
+      }
+
+      for(const QString& category : std::as_const(m_configFileSampling)) if(!sampling.contains(category)) QCustomLog::applySampling(config,category,1.0);
+      for(auto i=sampling.cbegin();i!=sampling.cend();++i) QCustomLog::applySampling(config,i.key(),i.value());
+      m_configFileSampling=sampling.keys();
+
+      for(const QString& category : std::as_const(m_configFileRateLimits)) if(!rateLimits.contains(category)) QCustomLog::applyRateLimit(config,category,0,0);
+      for(auto i=rateLimits.cbegin();i!=rateLimits.cend();++i) QCustomLog::applyRateLimit(config,i.key(),i.value(),0);
+      m_configFileRateLimits=rateLimits.keys();
+
+      if(rulesSet) { config.categoryRules=compiledRules; m_configFileRules=!rules.isEmpty(); }
+   });
+
+   // after the publication, so a category that sees a new generation also reads the new snapshot
+   m_samplingGeneration++; m_rateGeneration++;
+   if(rulesSet) QCustomLog::categoryRulesChanged();
+
+   if(!valid) QCustomLog::callErrorHandler("Config file has invalid values, they were skipped");
+   return true;
+}
+
+QCustomLog::ConfigReader::ConfigReader()
+{
+   // the counters of the thread are not shared with other threads, so readers never contend for a cache line
+   m_counters=m_threadReaders ? m_threadReaders : QCustomLog::acquireReaderCounters();
+
+   // registers in the counter of the current epoch, retrying if a writer switched the epoch in between
+   while(true)
+   {
+      m_slot=m_configEpoch&1;
+      m_counters->readers[m_slot]++;
+      if((m_configEpoch&1)==m_slot) break;
+      m_counters->readers[m_slot]--;
+   }
+   m_config=QCustomLog::m_config;
+}
+
+QCustomLog::ReaderCounters* QCustomLog::acquireReaderCounters()
+{
+   // counters of exited threads are reused, so the list is bounded by the largest number of threads at once
+   m_configReadersMutex.lock();
+   ReaderCounters* counters=nullptr;
+   for(ReaderCounters* released:std::as_const(m_configReaders)) if(!released->inUse) { counters=released; break; }
+   if(!counters) { counters=new ReaderCounters(); m_configReaders.append(counters); }
+   counters->inUse=true;
+   m_configReadersMutex.unlock();
+
+   m_threadReaders=counters; m_threadReadersRelease.armed=true;
+   return counters;
+}
+
+QCustomLog::ReaderCountersRelease::~ReaderCountersRelease()
+{
+   if(!armed) return;
+
+   // no reader of the thread is left, messages of later thread-local destructors use the shared counters
+   ReaderCounters* counters=m_threadReaders; m_threadReaders=&m_sharedReaders;
+   m_configReadersMutex.lock();
+   counters->inUse=false;
+   m_configReadersMutex.unlock();
+}
+
+void QCustomLog::retireConfig(const Config* previous)
+{
+   QCustomLog::reclaimConfigs();
+
+   // new readers register in the other counters, so the previous counters only drain and both of them regularly reach zero
+   m_configEpoch++;
+   if(previous!=&m_defaultConfig) m_retiredConfigs.append({previous,{false,false}});
+}
+
+void QCustomLog::reclaimConfigs()
+{
+   // invariant: a reader registers in a counter before it loads the snapshot and stays registered until it is done with it,
+   // so every reader of a retired snapshot was already counted, in either counter of its thread, when the snapshot was replaced,
+   // once the counters of each epoch have been seen at zero after the retirement none of those readers is left and nobody can load the snapshot again,
+   // nobody waits for this grace period, the readers may be the calling thread itself, and they hold the snapshot only while a message is formatted
+   if(m_retiredConfigs.isEmpty()) return;
+
+   bool drained[2]={m_sharedReaders.readers[0]==0,m_sharedReaders.readers[1]==0};
+   m_configReadersMutex.lock();
+   for(const ReaderCounters* counters:std::as_const(m_configReaders)) { drained[0]=drained[0] && counters->readers[0]==0; drained[1]=drained[1] && counters->readers[1]==0; }
+   m_configReadersMutex.unlock();
+
+   for(qsizetype i=0;i<m_retiredConfigs.count();)
+   {
+      RetiredConfig& retired=m_retiredConfigs[i];
+      retired.drained[0]=retired.drained[0] || drained[0]; retired.drained[1]=retired.drained[1] || drained[1];
+      if(retired.drained[0] && retired.drained[1]) { delete retired.config; m_retiredConfigs.removeAt(i); }
+      else i++;
+   }
+}
+
+bool QCustomLog::initLogging(QString logDir, quint32 flushTime, quint32 maxFiles, quint32 maxFileSize)
+{
+   if(!logDir.isEmpty()) QCustomLog::normalizePath(logDir); else logDir=QCoreApplication::applicationDirPath()+"/";
+   if(!QCustomLog::ensureDirectoryWritable(logDir))
+   {
+      QCustomLog::callErrorHandler("Log directory is not writable");
+      return false;
+   }
+   m_logDir.setPath(logDir);
+
+   // limits first, the first rotation already prunes and preallocates by them
+   if(maxFiles<2) m_maxLogFiles=2; else m_maxLogFiles=maxFiles;
+   if(maxFileSize<(100*1024)) m_maxLogFileSize=(100*1024); else m_maxLogFileSize=maxFileSize;
+
+   // first-time log file creation or rotation
+   if(!QCustomLog::rotateLogFiles(m_logFileName)) return false;
+
+   // logging works without the crash ring, so its errors are only reported
+   if(m_crashRingSize>0) QCustomLog::openCrashRing();
+
+   if(flushTime>=1000)
+   {
+      m_logBufferEnabled=true;
+      m_logBufferTimer.setInterval(flushTime); m_logBufferTimer.setSingleShot(true);
+      QObject::connect(&m_logBufferTimer,&QTimer::timeout,qOverload<>(&QCustomLog::flushBuffer));
+   } else m_logBufferEnabled=false;
+
+   // summaries of ended floods and coalescing windows, and the release of retired snapshots do not depend on buffering
+   m_summaryTimer.setInterval(m_rateSummaryInterval/1000000);
+   QObject::connect(&m_summaryTimer,&QTimer::timeout,[]()
+   {
+      QCustomLog::logSuppressedSummaries(false); QCustomLog::logCoalescedSummaries(false);
+      m_configMutex.lock(); QCustomLog::reclaimConfigs(); m_configMutex.unlock(); // snapshots retired by the last change, e.g. with the clean route files they own
+   });
+   m_summaryTimer.start();
+
+   // colors are only for terminals, not for pipes and files
+   #ifdef Q_OS_WIN
+      m_consoleColors[0]=_isatty(1); m_consoleColors[1]=_isatty(2);
+   #else
+      m_consoleColors[0]=isatty(STDOUT_FILENO); m_consoleColors[1]=isatty(STDERR_FILENO);
+   #endif
+
+   // reserved capacity also survives resize(0) on Qt 5, so the swapped buffers keep it
+   m_logBuffer.reserve(64*1024); m_logBufferSpare.reserve(64*1024);
+   for(int i=0;i<2;i++) { m_consolePending[i].reserve(4096); m_consoleBatch[i].reserve(4096); }
+
+   if(m_consoleAsync) QCustomLog::startConsoleThread();
+   if(m_deferredFormatting) QCustomLog::startDeferredThread();
+   if(m_retentionMaxSize>0 || m_retentionMaxAge>0) QCustomLog::startJanitorThread();
+   #ifdef QCUSTOMLOG_IO_URING
+      if(m_uringEnabled) QCustomLog::uringInit();
+   #endif
+
+   qInstallMessageHandler(QCustomLog::messageHandler);
+
+   if(m_logBufferEnabled) QCustomLog::m_logBufferTimer.start();
+
+   // the process-wide threads belong to the application, not to an instance, and the singleton is not constructed without a custom instance,
+   // so the shutdown does not depend on a destructor
+   qRemovePostRoutine(QCustomLog::shutdownLogging); qAddPostRoutine(QCustomLog::shutdownLogging);
+
+   return true;
+}
+
+void QCustomLog::shutdownLogging()
+{
+   // later messages, e.g. from static destructors, go to the standard error instead of the closed outputs
+   qInstallMessageHandler(nullptr);
+   m_logBufferTimer.stop(); m_summaryTimer.stop();
+
+   QCustomLog::stopDeferredThread();
+   QCustomLog::logSuppressedSummaries(true); QCustomLog::logCoalescedSummaries(true);
+   QCustomLog::flushBuffer(false);
+   QCustomLog::stopConsoleThread();
+   QCustomLog::stopJanitorThread();
+   QCustomLog::closeLogFile();
+}
+
+void QCustomLog::messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& msg)
+{
+   qint64 timeNs=currentTimeNs();
+
+   #ifdef NDEBUG
+      if(type==QtMsgType::QtDebugMsg) return;
+   #endif
+
+   CategoryInfo* categoryInfo=QCustomLog::internCategory(context.category);
+   if(type!=QtMsgType::QtFatalMsg && QCustomLog::categoryRuleLevel(categoryInfo)>QCustomLog::levelIndex(type)) return; // messages that bypassed the category filter
+
+   // before any formatting, so the sampled out, coalesced and suppressed messages are almost free
+   if(m_samplingEnabled && !m_summaryBypass && (type==QtMsgType::QtDebugMsg || type==QtMsgType::QtInfoMsg))
+   {
+      if(!QCustomLog::samplingAllows(categoryInfo)) return;
+   }
+   if(m_coalesceEnabled && !m_summaryBypass && type!=QtMsgType::QtFatalMsg)
+   {
+      if(!QCustomLog::coalesceAllows(categoryInfo,type,context,msg,timeNs)) return;
+   }
+   if(m_rateLimitEnabled && !m_summaryBypass && type!=QtMsgType::QtCriticalMsg && type!=QtMsgType::QtFatalMsg)
+   {
+      // buckets refill by the monotonic time, so a wall clock step backwards does not silence them
+      quint64 suppressed=0; qint64 monotonicNs=monotonicTimeNs(); QByteArray suppressedFile; int suppressedLine=0;
+      if(!QCustomLog::rateLimitAllows(categoryInfo,context,monotonicNs,suppressed,suppressedFile,suppressedLine)) return;
+      if(suppressed>0) QCustomLog::logSuppressed(categoryInfo->utf8Name,suppressedFile,suppressedLine,suppressed);
+
+      // floods of other buckets that ended without a later message are summarized here too
+      qint64 summaryCheck=m_rateSummaryCheck;
+      if(monotonicNs>=summaryCheck && m_rateSummaryCheck.compare_exchange_strong(summaryCheck,monotonicNs+m_rateSummaryInterval)) QCustomLog::logSuppressedSummaries(false);
+   }
+
+   // only the raw values and pointers to the interned context strings are captured, the formatting thread does all string building
+   if(m_deferredFormatting && !m_deferredThreadOwner && type!=QtMsgType::QtCriticalMsg && type!=QtMsgType::QtFatalMsg)
+   {
+      QCustomLog::enqueueDeferred({timeNs,type,categoryInfo,QCustomLog::internContextString(context.file),QCustomLog::internContextString(context.function),msg,
+                                   m_threadFields ? *m_threadFields : QList<QCustomLogField>(),reinterpret_cast<quintptr>(QThread::currentThreadId())});
+      return;
+   }
+   if(m_deferredFormatting && !m_deferredThreadOwner) QCustomLog::drainDeferred(); // keeps the order of the output
+
+   QCustomLog::writeMessage(type,categoryInfo,context.file,context.function,msg,m_threadFields,timeNs,reinterpret_cast<quintptr>(QThread::currentThreadId()));
+}
+
+void QCustomLog::writeMessage(QtMsgType type, CategoryInfo* categoryInfo, const char* file, const char* function, const QString& msg,
+                              const QList<QCustomLogField>* fields, qint64 timeNs, quintptr threadId)
+{
+   QString message; const QString& category=categoryInfo->name;
+
+   if(type==QtMsgType::QtDebugMsg)
+   {
+      QString func=function;
+      if(func.indexOf("virtual ")==0) func.remove("virtual ");
+      func.remove(func.indexOf('(')+1,func.lastIndexOf(')')-func.indexOf('(')-1);
+      message=QString(file).remove(0,qMax(QString(file).lastIndexOf("\\"),QString(file).lastIndexOf("/"))+1)+": "+func+": "+msg;
+   } else message=msg;
+
+   // typed fields go to the asynchronous sinks as is, other outputs get them as text
+   QString plainMessage=message;
+   if(fields && !fields->isEmpty()) { QString fieldsText; QCustomLogField::appendText(fieldsText,*fields); message.append(' ').append(fieldsText); }
+
+   // formatted in the per-thread scratch buffers that keep their capacity, so the formatted line is not reallocated per message,
+   // nested messages, e.g. of an overrided sendLog(), use their own temporary buffers
+   FormatScratch nestedScratch;
+   FormatScratch& scratch=m_formatScratch.inUse ? nestedScratch : m_formatScratch;
+   struct ScratchRelease { FormatScratch& scratch; ~ScratchRelease() { scratch.inUse=false; } } scratchRelease{scratch};
+   scratch.inUse=true;
+   if(!scratch.reserved) { scratch.text.reserve(512); scratch.utf8.reserve(512); scratch.json.reserve(512); scratch.reserved=true; } // reserved capacity also survives resize(0) on Qt 5
+   qsizetype textCapacity=scratch.text.capacity(), utf8Capacity=scratch.utf8.capacity(), jsonCapacity=scratch.json.capacity(), cleanCapacity=scratch.clean.capacity();
+
+   // one snapshot for the whole message, settings may change concurrently, it is read only here,
+   // so the outputs below, e.g. a slow console, a durability wait or the overrided sendLog(), never delay its retirement
+   int cleanFd=-1; bool cleanToFile=true, clean, cleanConsole, utcMode;
+   QtMsgType minOutLevel, fileLevel; ConsoleStream consoleStream;
+   {
+      ConfigReader config;
+      clean=QCustomLog::cleanRoute(*config,categoryInfo,cleanFd,cleanToFile);
+      cleanConsole=config->cleanConsole; utcMode=config->utcMode; minOutLevel=config->minOutLevel; fileLevel=config->fileLevel; consoleStream=config->consoleStream;
+
+      QCustomLog::formatStamp(scratch,config->logMessageFormat,timeNs,utcMode);
+   }
+
+   // slightly spaghettified for performance
+   QString& formattedMessage=scratch.text;
+   formattedMessage.resize(0); formattedMessage.append(scratch.stamp);
+   switch(type)
+   {
+      case QtMsgType::QtInfoMsg:
+         formattedMessage.append(QLatin1String(" [INF] [")).append(category).append(QLatin1String("] ")).append(message);
+         break;
+      case QtMsgType::QtWarningMsg:
+         formattedMessage.append(QLatin1String(" [WRN] [")).append(category).append(QLatin1String("] ")).append(message);
+         break;
+      case QtMsgType::QtCriticalMsg:
+         formattedMessage.append(QLatin1String(" [CRT] [")).append(category).append(QLatin1String("] ")).append(message);
+         break;
+      case QtMsgType::QtFatalMsg:
+         formattedMessage.append(QLatin1String(" [FTL] [")).append(category).append(QLatin1String("] ")).append(message);
+
+         // must not write or transmit potentially sensitive information when prohibited, even at fatal levels
+         if(!clean || cleanToFile)
+         {
+            QByteArray fatalLine=formattedMessage.toUtf8();
+            if(m_fileFormat==FileFormat::JsonLines) QCustomLog::formatJsonLine(scratch.json,scratch,timeNs,utcMode,type,category,plainMessage,fields,threadId);
+            QCustomLog::enqueueMessage(m_fileFormat==FileFormat::JsonLines ? scratch.json : fatalLine);
+            QCustomLog::flushBuffer(true);
+
+            if(m_customInstance) QCustomLog::sendToInstance({timeNs,type,category,message,fields,threadId,fatalLine,utcMode});
+         }
+
+         // fatal level implies that it is better to get something than to miss something due to keeping a clean output,
+         // the line goes through the console writer like any other, so the stream and the colors of terminals are kept,
+         // the pending asynchronous lines are written before it, as Qt aborts once the handler returns
+         QCustomLog::stopConsoleThread();
+         {
+            QByteArray& fatalConsoleLine=scratch.utf8;
+            fatalConsoleLine.resize(0);
+            if(!cleanConsole) appendUtf8(fatalConsoleLine,formattedMessage); else appendUtf8(fatalConsoleLine.append("[FTL] ",6),msg);
+            QCustomLog::consoleWrite(consoleStream,type,fatalConsoleLine,!cleanConsole);
+         }
+         break;
+      default: // QtMsgType::QtDebugMsg
+         formattedMessage.append(QLatin1String(" [DBG] [")).append(category).append(QLatin1String("] ")).append(message);
+         break;
+   }
+
+   // fatal messages are written completely above, Qt aborts after the handler
+   if(type==QtMsgType::QtFatalMsg) return;
+
+   // written directly instead of re-entering Qt logging from inside the handler
+   bool toConsole=!clean && !cleanConsole && QCustomLog::levelGreaterOrEqual(type,minOutLevel);
+   QByteArray& formattedLine=scratch.utf8;
+   formattedLine.resize(0); if(toConsole || m_fileFormat==FileFormat::Text || m_customInstance) appendUtf8(formattedLine,formattedMessage);
+   if(toConsole) QCustomLog::consoleWrite(consoleStream,type,formattedLine,true);
+   else if(clean)
+   {
+      // the line break is written with the line to a file descriptor, the console writer adds its own
+      QByteArray& cleanLine=scratch.clean;
+      cleanLine.resize(0); appendUtf8(cleanLine,msg);
+      if(cleanFd<0) QCustomLog::consoleWrite(consoleStream,type,cleanLine,false); else QCustomLog::cleanWrite(cleanFd,cleanLine.append('\n'));
+   }
+
+   // must not write or transmit potentially sensitive information when prohibited
+   if(!clean || cleanToFile)
+   {
+      // routes are computed once per category and sinks change, so the rejecting sinks cost nothing here,
+      // the cached routes are read without the lock, it is taken only to recompute them or to reach the asynchronous sinks of the list
+      quint64 route=(categoryInfo->generation==m_routesGeneration) ? categoryInfo->routes[QCustomLog::levelIndex(type)].load() : ~0ull;
+      if(route>1)
+      {
+         m_sinksLock.lockForRead();
+         if(categoryInfo->generation!=m_routesGeneration) QCustomLog::computeRoutes(categoryInfo);
+         route=categoryInfo->routes[QCustomLog::levelIndex(type)];
+         if(route>1) // any asynchronous sink
+         {
+            QCustomLogSink::Slot slot; QCustomLogSink::fillSlot(slot,timeNs,type,category,plainMessage,fields,threadId);
+            for(int i=0;i<m_sinks.count();i++) if(route&(1ull<<(i+1))) m_sinks.at(i)->enqueue(slot);
+         }
+         m_sinksLock.unlock();
+      }
+
+      if((route&1) && QCustomLog::levelGreaterOrEqual(type,fileLevel))
+      {
+         if(m_fileFormat==FileFormat::JsonLines) QCustomLog::formatJsonLine(scratch.json,scratch,timeNs,utcMode,type,category,plainMessage,fields,threadId);
+         quint64 ticket=QCustomLog::enqueueMessage(m_fileFormat==FileFormat::JsonLines ? scratch.json : formattedLine);
+         if(type==QtMsgType::QtCriticalMsg && m_durability!=Durability::None) QCustomLog::waitForDurability(ticket);
+         else if(!m_logBufferEnabled) QCustomLog::flushBuffer(false);
+      }
+
+      // the base sendLog() is empty, so without an inheritor there is nothing to lock or call
+      if(m_customInstance) QCustomLog::sendToInstance({timeNs,type,category,message,fields,threadId,formattedLine,utcMode});
+   }
+
+   if(scratch.text.capacity()!=textCapacity || scratch.utf8.capacity()!=utf8Capacity || scratch.json.capacity()!=jsonCapacity || scratch.clean.capacity()!=cleanCapacity)
+      m_bufferGrowths++;
+}
+
+void QCustomLog::sendToInstance(const QCustomLogRecordView& record)
+{
+   // messages logged by the overrided sendLog() itself reach the handler directly on the formatting thread or from summaries,
+   // without the recursion guard of Qt, so they are written to the other outputs only instead of locking the mutex again
+   if(m_customHandlerActive) return;
+
+   m_customHandlerActive=true;
+   m_customHandlerMutex.lock();
+   m_customInstance->sendRecord(record);
+   m_customHandlerMutex.unlock();
+   m_customHandlerActive=false;
+}
+
+void QCustomLog::sendRecord(const QCustomLogRecordView& record)
+{
+   sendLog(dateTimeFromNs(record.time,record.utcMode),record.type,record.category,record.message);
+}
+
+void QCustomLog::setSampling(const QString& category, double rate)
+{
+   QCustomLog::updateConfig([&category,rate](Config& config) { QCustomLog::applySampling(config,category,rate); });
+   m_samplingGeneration++;
+}
+
+void QCustomLog::applySampling(Config& config, const QString& category, double rate)
+{
+   rate=qBound(0.0,rate,1.0);
+   if(category.isEmpty()) config.samplingDefault=rate;
+   else if(rate>=1.0) config.samplingRates.remove(category);
+   else config.samplingRates.insert(category,rate);
+}
+
+void QCustomLog::setAdaptiveSampling(quint32 maxBufferMessages, float maxFlushTime)
+{
+   // through the snapshot update, which switches the sampling flag from the thresholds and the published rates at once
+   QCustomLog::updateConfig([maxBufferMessages,maxFlushTime](Config&)
+   {
+      m_samplingMutex.lock();
+      m_adaptiveMaxMessages=maxBufferMessages; m_adaptiveMaxFlushTime=maxFlushTime;
+      m_samplingFactor=1.0;
+      m_samplingMutex.unlock();
+   });
+   m_samplingGeneration++;
+}
+
+QHash<QString,double> QCustomLog::samplingRates()
+{
+   QHash<QString,double> rates;
+   ConfigReader config;
+
+   m_samplingMutex.lock();
+   for(auto i=config->samplingRates.cbegin();i!=config->samplingRates.cend();++i) rates.insert(i.key(),i.value()*m_samplingFactor);
+   rates.insert(QString(),config->samplingDefault*m_samplingFactor);
+   m_samplingMutex.unlock();
+
+   return rates;
+}
+
+bool QCustomLog::setCategoryRules(const QString& rules)
+{
+   QHash<QString,int> compiled;
+   bool valid=QCustomLog::compileCategoryRules(rules,compiled);
+
+   QCustomLog::updateConfig([&compiled](Config& config) { config.categoryRules=compiled; });
+   QCustomLog::categoryRulesChanged();
+
+   return valid;
+}
+
+bool QCustomLog::compileCategoryRules(const QString& rules, QHash<QString,int>& compiled)
+{
+   bool valid=true;
+   static const QRegularExpression separators("[;\\n]");
+   for(const QString& rule:rules.split(separators,Qt::SkipEmptyParts))
+   {
+      int separator=rule.indexOf('=');
+      QString pattern=rule.left(separator).trimmed(), levelName=rule.mid(separator+1).trimmed().toLower();
+      QtMsgType level;
+      if(separator<=0 || pattern.isEmpty() || (pattern.contains('*') && pattern!="*" && (!pattern.endsWith(".*") || pattern.count('*')>1))) { if(!rule.trimmed().isEmpty()) valid=false; continue; }
+      if(levelName=="off") compiled.insert(pattern,4);
+      else if(QCustomLog::parseLevel(levelName,level)) compiled.insert(pattern,QCustomLog::levelIndex(level));
+      else valid=false;
+   }
+   return valid;
+}
+
+void QCustomLog::categoryRulesChanged()
+{
+   m_rulesGeneration++; // after the publication, so a category that sees the new generation also reads the new rules
+
+   // installing the filter again makes Qt reevaluate all existing categories
+   QLoggingCategory::CategoryFilter previous=QLoggingCategory::installFilter(&QCustomLog::categoryFilter);
+   if(previous!=&QCustomLog::categoryFilter)
+   {
+      // the first installation evaluated the categories before the previous filter was known, e.g. QT_LOGGING_RULES, so with it they are evaluated again
+      m_previousCategoryFilter=previous;
+      QLoggingCategory::installFilter(&QCustomLog::categoryFilter);
+   }
+}
+
+int QCustomLog::categoryRuleLevel(CategoryInfo* category)
+{
+   quint64 generation=m_rulesGeneration;
+   if(category->rulesGeneration!=generation)
+   {
+      // the most specific pattern wins, so prefixes are tried from the longest one, which is a walk up the category hierarchy
+      ConfigReader config;
+      const QHash<QString,int>& rules=config->categoryRules;
+      int level=-1;
+      if(!rules.isEmpty())
+      {
+         level=rules.value(category->name,-1);
+         for(qsizetype dot=category->name.lastIndexOf('.');level<0 && dot>0;dot=category->name.lastIndexOf('.',dot-1))
+            level=rules.value(category->name.left(dot)+".*",-1);
+         if(level<0) level=rules.value("*",-1);
+      }
+      category->ruleLevel=level;
+      category->rulesGeneration=generation;
+   }
+   return category->ruleLevel;
+}
+
+void QCustomLog::categoryFilter(QLoggingCategory* category)
+{
+   QLoggingCategory::CategoryFilter previous=m_previousCategoryFilter;
+   if(previous) previous(category);
+
+   int level=QCustomLog::categoryRuleLevel(QCustomLog::internCategory(category->categoryName()));
+   if(level<0) return;
+   category->setEnabled(QtMsgType::QtDebugMsg,level<=0);
+   category->setEnabled(QtMsgType::QtInfoMsg,level<=1);
+   category->setEnabled(QtMsgType::QtWarningMsg,level<=2);
+   category->setEnabled(QtMsgType::QtCriticalMsg,level<=3);
+}
+
+bool QCustomLog::samplingAllows(CategoryInfo* category)
+{
+   quint64 generation=m_samplingGeneration;
+   if(category->samplingGeneration!=generation)
+   {
+      ConfigReader config;
+      m_samplingMutex.lock();
+      double rate=config->samplingRates.value(category->name,config->samplingDefault)*m_samplingFactor;
+      category->samplingThreshold=(rate>=1.0) ? (1ull<<32) : (quint64)(rate*4294967296.0);
+      m_samplingMutex.unlock();
+      category->samplingGeneration=generation;
+   }
+
+   // thread-local xorshift is much cheaper than a shared generator and good enough for sampling
+   static thread_local quint64 state=QRandomGenerator::global()->generate64()|1;
+   state^=state>>12; state^=state<<25; state^=state>>27;
+   return ((state*0x2545F4914F6CDD1Dull)>>32)<category->samplingThreshold;
+}
+
+void QCustomLog::updateAdaptiveSampling(qsizetype bufferMessages, float flushTime)
+{
+   if(!m_samplingEnabled) return;
+
+   m_samplingMutex.lock();
+   if(m_adaptiveMaxMessages>0 || m_adaptiveMaxFlushTime>0.0f)
+   {
+      bool overloaded=(m_adaptiveMaxMessages>0 && bufferMessages>m_adaptiveMaxMessages) || (m_adaptiveMaxFlushTime>0.0f && flushTime>m_adaptiveMaxFlushTime);
+      double factor=overloaded ? qMax(m_samplingFactor/2.0,1.0/1024.0) : qMin(m_samplingFactor*2.0,1.0);
+      if(factor!=m_samplingFactor) { m_samplingFactor=factor; m_samplingGeneration++; }
+   }
+   m_samplingMutex.unlock();
+}
+
+void QCustomLog::setRateLimit(quint32 rate, quint32 burst, RateLimitKey key)
+{
+   QCustomLog::updateConfig([rate,burst,key](Config& config) { config.rateLimit={(double)rate,(double)(burst>0 ? burst : rate)}; config.rateLimitKey=key; });
+   m_rateGeneration++;
+}
+
+void QCustomLog::setCategoryRateLimit(const QString& category, quint32 rate, quint32 burst)
+{
+   QCustomLog::updateConfig([&category,rate,burst](Config& config) { QCustomLog::applyRateLimit(config,category,rate,burst); });
+   m_rateGeneration++;
+}
+
+void QCustomLog::applyRateLimit(Config& config, const QString& category, quint32 rate, quint32 burst)
+{
+   if(rate>0) config.categoryRateLimits.insert(category,{(double)rate,(double)(burst>0 ? burst : rate)});
+   else config.categoryRateLimits.remove(category);
+}
+
+bool QCustomLog::rateLimitAllows(CategoryInfo* category, const QMessageLogContext& context, qint64 monotonicNs, quint64& suppressed, QByteArray& file, int& line)
+{
+   // the limit is looked up by name only after a rate limit change, later messages use the buckets of the interned category
+   QMutexLocker locker(&category->rateMutex);
+   quint64 generation=m_rateGeneration;
+   if(category->rateGeneration!=generation)
+   {
+      ConfigReader config;
+      category->rateLimit=config->categoryRateLimits.value(category->name,config->rateLimit);
+      category->rateBySource=(config->rateLimitKey==RateLimitKey::SourceLocation);
+      category->rateGeneration=generation;
+
+      category->rateBucket={category->rateLimit.burst,monotonicNs,monotonicNs,0,QByteArray(),0};
+      category->sourceBuckets.clear();
+   }
+
+   const RateLimit& limit=category->rateLimit;
+   if(limit.rate<=0.0) return true;
+
+   TokenBucket* bucket=&category->rateBucket;
+   if(category->rateBySource && context.file)
+   {
+      // lookup without allocation, the file name is copied only into a new bucket
+      auto sourceBucket=category->sourceBuckets.find(qMakePair(QByteArray::fromRawData(context.file,qstrlen(context.file)),context.line));
+      if(sourceBucket==category->sourceBuckets.end())
+      {
+         QByteArray file(context.file);
+         sourceBucket=category->sourceBuckets.insert(qMakePair(file,context.line),{limit.burst,monotonicNs,monotonicNs,0,file,context.line});
+      }
+      bucket=&sourceBucket.value();
+   }
+
+   // the time is taken before the lock, so a concurrent message of the bucket may have refilled it a little later
+   TokenBucket& state=*bucket;
+   if(monotonicNs>state.refillTime)
+   {
+      state.tokens=qMin(limit.burst,state.tokens+(double)(monotonicNs-state.refillTime)*limit.rate/1e9);
+      state.refillTime=monotonicNs;
+   }
+
+   if(state.tokens<1.0) { state.suppressed++; return false; }
+   state.tokens-=1.0;
+
+   // the summary goes right before the first allowed message, but not too often during a long flood,
+   // with the location of the bucket, the category bucket has none even if the allowed message has one
+   if(state.suppressed>0 && monotonicNs-state.summaryTime>=m_rateSummaryInterval)
+   {
+      suppressed=state.suppressed; file=state.file; line=state.line;
+      state.suppressed=0; state.summaryTime=monotonicNs;
+   }
+   return true;
+}
+
+void QCustomLog::logSuppressedSummaries(bool all)
+{
+   if(!m_rateLimitEnabled) return;
+
+   struct Summary { QByteArray category; QByteArray file; int line; quint64 suppressed; };
+   QList<Summary> summaries; qint64 timeNs=monotonicTimeNs();
+
+   m_categoriesLock.lockForRead();
+   for(CategoryInfo* category:std::as_const(m_categories))
+   {
+      auto collect=[&summaries,category,all,timeNs](TokenBucket& state)
+      {
+         if(state.suppressed==0 || (!all && timeNs-state.summaryTime<m_rateSummaryInterval)) return;
+         summaries.append({category->utf8Name,state.file,state.line,state.suppressed});
+         state.suppressed=0; state.summaryTime=timeNs;
+      };
+
+      category->rateMutex.lock();
+      collect(category->rateBucket);
+      for(auto bucket=category->sourceBuckets.begin();bucket!=category->sourceBuckets.end();++bucket) collect(bucket.value());
+      category->rateMutex.unlock();
+   }
+   m_categoriesLock.unlock();
+
+   for(const Summary& summary:std::as_const(summaries)) QCustomLog::logSuppressed(summary.category,summary.file,summary.line,summary.suppressed);
+}
+
+void QCustomLog::logSuppressed(const QByteArray& category, const QByteArray& file, int line, quint64 suppressed)
+{
+   QString msg="Suppressed "+QString::number(suppressed)+" similar messages";
+   if(!file.isEmpty()) msg.append(" from "+QString(file).remove(0,qMax(QString(file).lastIndexOf("\\"),QString(file).lastIndexOf("/"))+1)+":"+QString::number(line));
+
+   QCustomLog::logSummary(QtMsgType::QtWarningMsg,category,file.isEmpty() ? nullptr : file.constData(),line,nullptr,msg,nullptr);
+}
+
+void QCustomLog::setCoalescing(quint32 window, bool consecutiveOnly)
+{
+   m_coalesceSettingsMutex.lock();
+   QCustomLog::logCoalescedSummaries(true); // runs of the previous settings
+
+   m_coalesceEnabled=false;
+   m_coalesceWindow=(qint64)window*1000000; m_coalesceConsecutive=consecutiveOnly;
+   m_categoriesLock.lockForRead();
+   for(CategoryInfo* category:std::as_const(m_categories))
+   {
+      category->coalesceMutex.lock();
+      category->coalesced.clear();
+      category->coalesceMutex.unlock();
+   }
+   m_categoriesLock.unlock();
+   m_coalesceEnabled=(window>0);
+   m_coalesceSettingsMutex.unlock();
+}
+
+bool QCustomLog::coalesceAllows(CategoryInfo* category, QtMsgType type, const QMessageLogContext& context, const QString& msg, qint64 timeNs)
+{
+   // the window is measured by the monotonic clock, so a wall clock step backwards does not stretch it, the epoch time is only displayed
+   quint64 hash=((quint64)qHash(msg)*0x9E3779B97F4A7C15ull)^(quint64)QCustomLog::levelIndex(type);
+   qint64 monotonicNs=monotonicTimeNs(), window=m_coalesceWindow;
+   CoalescedMessage summary; bool haveSummary=false;
+
+   category->coalesceMutex.lock();
+   quint64 key=m_coalesceConsecutive ? 0 : hash;
+   auto entry=category->coalesced.find(key);
+   if(entry!=category->coalesced.end())
+   {
+      CoalescedMessage& state=entry.value();
+      if(state.hash==hash && state.type==type && monotonicNs-state.windowStart<window && state.message==msg)
+      {
+         state.repeats++; state.lastTime=timeNs;
+         category->coalesceMutex.unlock();
+         return false;
+      }
+
+      // another message or the window is over, the run is closed and this message starts a new one
+      if(state.repeats>0) { summary=state; haveSummary=true; }
+      state={hash,type,msg,QByteArray(context.file),context.line,QByteArray(context.function),timeNs,timeNs,monotonicNs,0};
+   }
+   else
+   {
+      // forget expired messages without repeats to keep the table bounded
+      if(category->coalesced.count()>=m_coalesceMaxEntries)
+      {
+         for(auto i=category->coalesced.begin();i!=category->coalesced.end();)
+         {
+            if(i.value().repeats==0 && monotonicNs-i.value().windowStart>=window) i=category->coalesced.erase(i); else ++i;
+         }
+      }
+      if(category->coalesced.count()<m_coalesceMaxEntries)
+         category->coalesced.insert(key,{hash,type,msg,QByteArray(context.file),context.line,QByteArray(context.function),timeNs,timeNs,monotonicNs,0});
+   }
+   category->coalesceMutex.unlock();
+
+   if(haveSummary)
+   {
+      bool utcMode=ConfigReader()->utcMode;
+      QList<QCustomLogField> fields={{"repeated",summary.repeats},{"first",QCustomLog::formatTimeNs(summary.firstTime,utcMode)},{"last",QCustomLog::formatTimeNs(summary.lastTime,utcMode)}};
+      QCustomLog::logSummary(summary.type,category->utf8Name,QCustomLog::contextString(summary.file),summary.line,QCustomLog::contextString(summary.function),summary.message,&fields);
+   }
    return true;
 }
 
-bool QCustomLog::initLogging(QString logDir, quint32 flushTime, quint32 maxFiles, quint32 maxFileSize)
+void QCustomLog::logCoalescedSummaries(bool all)
 {
-   if(!logDir.isEmpty()) QCustomLog::normalizePath(logDir); else logDir=QCoreApplication::applicationDirPath()+"/";
-   if(!QCustomLog::ensureDirectoryWritable(logDir))
+   if(!m_coalesceEnabled) return;
+
+   struct Summary { QByteArray category; CoalescedMessage message; };
+   QList<Summary> summaries; qint64 monotonicNs=monotonicTimeNs(), window=m_coalesceWindow;
+
+   m_categoriesLock.lockForRead();
+   for(CategoryInfo* category:std::as_const(m_categories))
    {
-      QCustomLog::callErrorHandler("Log directory is not writable");
-      return false;
+      category->coalesceMutex.lock();
+      for(auto i=category->coalesced.begin();i!=category->coalesced.end();)
+      {
+         bool expired=(monotonicNs-i.value().windowStart>=window);
+         if(i.value().repeats>0 && (all || expired)) { summaries.append({category->utf8Name,i.value()}); i.value().repeats=0; }
+         if(expired) i=category->coalesced.erase(i); else ++i;
+      }
+      category->coalesceMutex.unlock();
    }
-   m_logDir.setPath(logDir);
+   m_categoriesLock.unlock();
 
-   // first-time log file creation or rotation
-   if(!QCustomLog::rotateLogFiles(m_logFileName)) return false;
+   bool utcMode=ConfigReader()->utcMode;
+   for(const Summary& summary:std::as_const(summaries))
+   {
+      const CoalescedMessage& message=summary.message;
+      QList<QCustomLogField> fields={{"repeated",message.repeats},{"first",QCustomLog::formatTimeNs(message.firstTime,utcMode)},{"last",QCustomLog::formatTimeNs(message.lastTime,utcMode)}};
+      QCustomLog::logSummary(message.type,summary.category,QCustomLog::contextString(message.file),message.line,QCustomLog::contextString(message.function),message.message,&fields);
+   }
+}
 
-   if(maxFiles<2) m_maxLogFiles=2; else m_maxLogFiles=maxFiles;
-   if(maxFileSize<(100*1024)) m_maxLogFileSize=(100*1024); else m_maxLogFileSize=maxFileSize;
+void QCustomLog::logSummary(QtMsgType type, const QByteArray& category, const char* file, int line, const char* function,
+                            const QString& msg, const QList<QCustomLogField>* fields)
+{
+   // directly, because logging through Qt from inside the handler would be caught by its recursion guard
+   QMessageLogContext context(file,line,function,category.constData());
+   const QList<QCustomLogField>* threadFields=m_threadFields; m_threadFields=fields; // fields of the current thread belong to another message
+   m_summaryBypass=true;
+   QCustomLog::messageHandler(type,context,msg);
+   m_summaryBypass=false; m_threadFields=threadFields;
+}
 
-   if(flushTime>=1000)
+QString QCustomLog::formatTimeNs(qint64 timeNs, bool utcMode)
+{
+   // ISO strings of local times have no offset, so the local time is converted to a fixed offset, UTC times get "Z"
+   QDateTime time=dateTimeFromNs(timeNs,utcMode);
+   if(!utcMode) time=time.toOffsetFromUtc(time.offsetFromUtc());
+   return time.toString(Qt::ISODateWithMs);
+}
+
+void QCustomLog::formatStamp(FormatScratch& scratch, const QString& format, qint64 timeNs, bool utcMode)
+{
+   if(utcMode!=scratch.stampUtc || format!=scratch.stampFormat)
    {
-      m_logBufferEnabled=true;
-      m_logBufferTimer.setInterval(flushTime); m_logBufferTimer.setSingleShot(true);
-      QObject::connect(&m_logBufferTimer,&QTimer::timeout,qOverload<>(&QCustomLog::flushBuffer));
-   } else m_logBufferEnabled=false;
+      scratch.stampFormat=format; scratch.stampUtc=utcMode;
+      scratch.stampField=millisecondsField(format); scratch.stampKey=-1;
+   }
 
-   qInstallMessageHandler(QCustomLog::messageHandler);
+   // the date is built once per second, the only place unless sendLog() needs it, and the milliseconds of the text are rewritten in place
+   qint64 nowMs=timeNs/1000000, key=(scratch.stampField==-2) ? nowMs : nowMs/1000;
+   if(key!=scratch.stampKey)
+   {
+      QDateTime time=dateTimeFromNs(timeNs,utcMode);
+      if(scratch.stampField>=0)
+      {
+         // the format is split outside of quotes, so both parts are valid formats
+         scratch.stamp=time.toString(format.left(scratch.stampField)); scratch.stampMsPos=scratch.stamp.size();
+         scratch.stamp.append(QLatin1String("000")).append(time.toString(format.mid(scratch.stampField+3)));
+      }
+      else { scratch.stamp=time.toString(format); scratch.stampMsPos=-1; }
+      scratch.stampKey=key;
+   }
+   if(scratch.stampMsPos>=0) writeMilliseconds(scratch.stamp.data()+scratch.stampMsPos,(int)(nowMs%1000));
+}
 
-   if(m_logBufferEnabled) QCustomLog::m_logBufferTimer.start();
+void QCustomLog::formatJsonLine(QByteArray& line, FormatScratch& scratch, qint64 timeNs, bool utcMode, QtMsgType type, const QString& category,
+                                const QString& message, const QList<QCustomLogField>* fields, quintptr threadId)
+{
+   static const char* const levels[5]={"debug","info","warning","critical","fatal"};
 
-   return true;
+   line.resize(0);
+   line.append("{\"time\":");
+   if(m_jsonEpochTime) appendNumber(line,(quint64)timeNs);
+   else
+   {
+      // the ISO time is built once per second like the text timestamp, the UTC offset can only change with it
+      qint64 nowMs=timeNs/1000000;
+      if(nowMs/1000!=scratch.isoSecond || utcMode!=scratch.isoUtc)
+      {
+         scratch.iso=QCustomLog::formatTimeNs(timeNs,utcMode).toLatin1(); scratch.isoMsPos=scratch.iso.indexOf('.')+1;
+         scratch.isoSecond=nowMs/1000; scratch.isoUtc=utcMode;
+      }
+      if(scratch.isoMsPos>0) writeMilliseconds(scratch.iso.data()+scratch.isoMsPos,(int)(nowMs%1000));
+      line.append('"').append(scratch.iso).append('"');
+   }
+   line.append(",\"level\":\"").append(levels[QCustomLog::levelIndex(type)]).append('"');
+   line.append(",\"category\":"); appendJsonString(line,category);
+   line.append(",\"thread\":"); appendNumber(line,(quint64)threadId);
+   line.append(",\"message\":"); appendJsonString(line,message);
+   if(fields) QCustomLogField::appendJson(line,*fields);
+   line.append('}');
 }
 
-void QCustomLog::messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& msg)
+void QCustomLog::consoleWrite(ConsoleStream consoleStream, QtMsgType type, const QByteArray& line, bool colored)
 {
-   QDateTime now=m_utcMode ? QDateTime::currentDateTimeUtc() : QDateTime::currentDateTime();
-   QString message; QString category=QString(context.category);
+   static const char* const colors[5]={"\033[90m","","\033[33m","\033[31m","\033[35m"};
 
-   #ifdef NDEBUG
-      if(type==QtMsgType::QtDebugMsg) return;
-   #endif
+   int stream=(consoleStream==ConsoleStream::StdOut || (consoleStream==ConsoleStream::Split && (type==QtMsgType::QtDebugMsg || type==QtMsgType::QtInfoMsg))) ? 0 : 1;
+   const char* color=(colored && m_consoleColors[stream]) ? colors[QCustomLog::levelIndex(type)] : "";
 
-   if(type==QtMsgType::QtDebugMsg)
+   m_consoleMutex.lock();
+   QByteArray& pending=m_consolePending[stream];
+   if(m_consoleThread)
    {
-      QString func=context.function;
-      if(func.indexOf("virtual ")==0) func.remove("virtual ");
-      func.remove(func.indexOf('(')+1,func.lastIndexOf(')')-func.indexOf('(')-1);
-      message=QString(context.file).remove(0,qMax(QString(context.file).lastIndexOf("\\"),QString(context.file).lastIndexOf("/"))+1)+": "+func+": "+msg;
-   } else message=msg;
+      // bounded, so a stalled stream costs at most the limit of memory and never blocks producers unless requested
+      qint64 size=line.size()+(*color ? qstrlen(color)+5 : 1);
+      if(m_consolePendingBytes+size>m_consoleMaxBytes)
+      {
+         if(m_consoleOverflow==ConsoleOverflow::DropNewest) { m_consoleMutex.unlock(); m_consoleDropped++; return; }
+         while(m_consoleThread && m_consolePendingBytes>0 && m_consolePendingBytes+size>m_consoleMaxBytes) m_consoleSpaceCondition.wait(&m_consoleMutex);
+      }
+      if(*color) pending.append(color).append(line).append("\033[0m\n",5); else pending.append(line).append('\n');
+      m_consolePendingBytes+=size;
+      m_consoleCondition.wakeOne();
+      m_consoleMutex.unlock();
+      return;
+   }
+   if(*color) pending.append(color).append(line).append("\033[0m\n",5); else pending.append(line).append('\n');
+   quint64 ticket=++m_consoleEnqueued;
 
-   // slightly spaghettified for performance
-   QString formattedMessage=now.toString(m_logMessageFormat);
-   switch(type)
+   // group commit: a thread that finds no writer writes all pending lines in one batch, including those of the waiting threads,
+   // and hands over, so contention turns into fewer and larger writes, every caller waits for its line and writes at most one batch
+   while(m_consoleWritten<ticket)
    {
-      case QtMsgType::QtInfoMsg:
-         formattedMessage.append(" [INF] ["+category+"] "+message);
-         if(m_cleanLogCategory.isEmpty())
-         {
-            if(QCustomLog::levelGreaterOrEqual(type,m_minOutLevel)) qInfo().noquote() << formattedMessage;
-         } else if(category==m_cleanLogCategory) qInfo().noquote() << msg;
-         break;
-      case QtMsgType::QtWarningMsg:
-         formattedMessage.append(" [WRN] ["+category+"] "+message);
-         if(m_cleanLogCategory.isEmpty())
-         {
-            if(QCustomLog::levelGreaterOrEqual(type,m_minOutLevel)) qWarning().noquote() << "\033[33m"+formattedMessage+"\033[0m";
-         } else if(category==m_cleanLogCategory) qWarning().noquote() << msg;
-         break;
-      case QtMsgType::QtCriticalMsg:
-         formattedMessage.append(" [CRT] ["+category+"] "+message);
-         if(m_cleanLogCategory.isEmpty())
-         {
-            if(QCustomLog::levelGreaterOrEqual(type,m_minOutLevel)) qCritical().noquote() << "\033[31m"+formattedMessage+"\033[0m";
-         } else if(category==m_cleanLogCategory) qCritical().noquote() << msg;
-         break;
-      case QtMsgType::QtFatalMsg:
-         formattedMessage.append(" [FTL] ["+category+"] "+message);
+      if(m_consoleWriting) { m_consoleWrittenCondition.wait(&m_consoleMutex); continue; }
+      m_consoleWriting=true;
 
-         // must not write or transmit potentially sensitive information when prohibited, even at fatal levels
-         if(m_cleanLogCategory.isEmpty() || category!=m_cleanLogCategory || m_cleanToFile)
-         {
-            m_logBufferMutex.lock();
-            m_logBuffer.enqueue(formattedMessage);
-            m_logBufferMutex.unlock();
-            QCustomLog::flushBuffer(true);
+      // swapped buffers keep their capacity, so batches are not reallocated in the steady state
+      m_consoleBatch[0].swap(m_consolePending[0]); m_consoleBatch[1].swap(m_consolePending[1]);
+      quint64 batchTicket=m_consoleEnqueued;
+      m_consoleMutex.unlock();
 
-            m_customHandlerMutex.lock();
-            QCustomLog::instance().sendLog(now,type,category,message);
-            m_customHandlerMutex.unlock();
-         }
+      for(int i=0;i<2;i++)
+      {
+         if(m_consoleBatch[i].isEmpty()) continue;
+         writeAll(i+1,m_consoleBatch[i].constData(),m_consoleBatch[i].size()); // standard output and error descriptors
+         m_consoleBatch[i].resize(0);
+      }
 
-         // fatal level implies that it is better to get something than to miss something due to keeping a clean output
-         #if QT_VERSION >= QT_VERSION_CHECK(6,5,0)
-            if(m_cleanLogCategory.isEmpty())
-            {
-               qFatal().noquote() << "\033[35m"+formattedMessage+"\033[0m";
-            } else qFatal().noquote() << "[FTL] "+msg;
-         #else
-            #ifdef __GNUC__
-               #pragma GCC diagnostic push
-               #pragma GCC diagnostic ignored "-Wformat-security"
-            #endif
-            if(m_cleanLogCategory.isEmpty())
-            {
-               qFatal(QString("\033[35m"+formattedMessage+"\033[0m").toUtf8().constData());
-            } else qFatal(QString("[FTL] "+msg).toUtf8().constData());
-            #ifdef __GNUC__
-               #pragma GCC diagnostic pop
-            #endif
-         #endif
-         break;
-      default: // QtMsgType::QtDebugMsg
-         formattedMessage.append(" [DBG] ["+category+"] "+message);
+      m_consoleMutex.lock();
+      m_consoleWritten=batchTicket; m_consoleWriting=false;
+      m_consoleWrittenCondition.wakeAll(); // the first waiter with unwritten lines takes over
+   }
+   m_consoleMutex.unlock();
+}
 
-         if(m_cleanLogCategory.isEmpty())
-         {
-            if(QCustomLog::levelGreaterOrEqual(type,m_minOutLevel)) qDebug().noquote() << "\033[90m"+formattedMessage+"\033[0m";
-         } else if(category==m_cleanLogCategory) qDebug().noquote() << msg;
+void QCustomLog::enqueueDeferred(DeferredMessage&& message)
+{
+   m_deferredMutex.lock();
+   if(m_deferredCount>=m_deferredQueueSize && m_deferredThread)
+   {
+      // dropped only if requested, by default the log file must not lose messages
+      if(m_deferredOverflow==DeferredOverflow::DropNewest) { m_deferredMutex.unlock(); m_deferredDropped++; return; }
+      while(m_deferredCount>=m_deferredQueueSize && m_deferredThread) m_deferredSpaceCondition.wait(&m_deferredMutex);
+   }
+   if(!m_deferredThread) // stopped, formatted by the logging thread
+   {
+      m_deferredMutex.unlock();
+      QCustomLog::writeMessage(message.type,message.category,message.file,message.function,message.message,
+                               message.fields.isEmpty() ? nullptr : &message.fields,message.time,message.threadId);
+      return;
+   }
+   // moved into a preallocated slot, the strings and fields are shared, not copied
+   m_deferredSlots[(m_deferredHead+m_deferredCount)%m_deferredQueueSize]=std::move(message); m_deferredCount++; m_deferredEnqueued++;
+   m_deferredCondition.wakeOne();
+   m_deferredMutex.unlock();
+}
+
+void QCustomLog::drainDeferred()
+{
+   m_deferredMutex.lock();
+   quint64 enqueued=m_deferredEnqueued;
+   while(m_deferredWritten<enqueued && m_deferredThread) m_deferredWrittenCondition.wait(&m_deferredMutex);
+   m_deferredMutex.unlock();
+}
+
+void QCustomLog::startDeferredThread()
+{
+   m_deferredMutex.lock();
+   if(!m_deferredThread)
+   {
+      if(m_deferredSlots.isEmpty()) m_deferredSlots.resize(m_deferredQueueSize);
+      m_deferredStopping=false;
+      m_deferredThread=QThread::create(&QCustomLog::deferredRun);
+      m_deferredThread->start();
+   }
+   m_deferredMutex.unlock();
+}
+
+void QCustomLog::stopDeferredThread()
+{
+   m_deferredMutex.lock();
+   QThread* thread=m_deferredThread;
+   m_deferredStopping=true;
+   m_deferredCondition.wakeAll();
+   m_deferredMutex.unlock();
+
+   // the thread writes all queued messages before it exits
+   if(thread) { thread->wait(); delete thread; }
+}
+
+void QCustomLog::deferredRun()
+{
+   m_deferredThreadOwner=true; // messages logged by this thread are written directly, those of an overrided sendLog() skip the custom instance
+   QVector<DeferredMessage> taken(m_deferredBatchSize);
+   quint64 droppedReported=m_deferredDropped;
+
+   m_deferredMutex.lock();
+   while(true)
+   {
+      while(m_deferredCount==0 && !m_deferredStopping) m_deferredCondition.wait(&m_deferredMutex);
+      if(m_deferredCount==0) // stopping and all messages are written, later messages are formatted by the logging threads
+      {
+         m_deferredThread=nullptr;
+         m_deferredSpaceCondition.wakeAll(); m_deferredWrittenCondition.wakeAll();
          break;
+      }
+
+      // slots are swapped with the empty ones, so the messages are formatted and freed here instead of under the lock
+      qsizetype count=0;
+      while(m_deferredCount>0 && count<m_deferredBatchSize)
+      {
+         std::swap(taken[count++],m_deferredSlots[m_deferredHead]);
+         m_deferredHead=(m_deferredHead+1)%m_deferredQueueSize; m_deferredCount--;
+      }
+      m_deferredSpaceCondition.wakeAll();
+      m_deferredMutex.unlock();
+
+      for(qsizetype i=0;i<count;i++)
+      {
+         DeferredMessage& message=taken[i];
+         QCustomLog::writeMessage(message.type,message.category,message.file,message.function,message.message,
+                                  message.fields.isEmpty() ? nullptr : &message.fields,message.time,message.threadId);
+         message.message=QString(); message.fields=QList<QCustomLogField>();
+      }
+
+      quint64 dropped=m_deferredDropped;
+      if(dropped!=droppedReported)
+      {
+         QCustomLog::logSummary(QtMsgType::QtWarningMsg,"QCustomLog",nullptr,0,nullptr,
+                                "Dropped "+QString::number(dropped-droppedReported)+" messages of the full deferred formatting queue",nullptr);
+         droppedReported=dropped;
+      }
+
+      m_deferredMutex.lock();
+      m_deferredWritten+=count;
+      m_deferredWrittenCondition.wakeAll();
    }
+   m_deferredMutex.unlock();
+}
 
-   // to avoid double logging, and also in case of a fatal log it usually doesn't get here because of the core dump
-   if(type==QtMsgType::QtFatalMsg) return;
+void QCustomLog::startConsoleThread()
+{
+   m_consoleMutex.lock();
+   if(!m_consoleThread)
+   {
+      m_consoleStopping=false;
+      m_consoleThread=QThread::create(&QCustomLog::consoleRun);
+      m_consoleThread->start();
+   }
+   m_consoleMutex.unlock();
+}
 
-   // must not write or transmit potentially sensitive information when prohibited
-   if(m_cleanLogCategory.isEmpty() || category!=m_cleanLogCategory || m_cleanToFile)
+void QCustomLog::stopConsoleThread()
+{
+   m_consoleMutex.lock();
+   // only the first caller joins the thread, concurrent ones, e.g. of fatal messages, wait for it to exit
+   QThread* thread=m_consoleStopping ? nullptr : m_consoleThread;
+   m_consoleStopping=true;
+   m_consoleCondition.wakeAll();
+   while(!thread && m_consoleThread) m_consoleSpaceCondition.wait(&m_consoleMutex);
+   m_consoleMutex.unlock();
+
+   // the thread writes all pending lines before it exits
+   if(thread) { thread->wait(); delete thread; }
+}
+
+void QCustomLog::consoleRun()
+{
+   quint64 droppedReported=0;
+
+   m_consoleMutex.lock();
+   while(true)
    {
-      if(QCustomLog::levelGreaterOrEqual(type,m_minOutFileLevel))
+      while(m_consolePendingBytes==0 && !m_consoleStopping) m_consoleCondition.wait(&m_consoleMutex);
+      if(m_consolePendingBytes==0) // stopping and all lines are written, later lines are written synchronously
       {
-         m_logBufferMutex.lock();
-         m_logBuffer.enqueue(formattedMessage);
-         m_logBufferMutex.unlock();
+         m_consoleThread=nullptr;
+         m_consoleSpaceCondition.wakeAll();
+         break;
+      }
 
-         if(type==QtMsgType::QtCriticalMsg) QCustomLog::flushBuffer(true);
-         else if(!m_logBufferEnabled) QCustomLog::flushBuffer(false);
+      m_consoleBatch[0].swap(m_consolePending[0]); m_consoleBatch[1].swap(m_consolePending[1]);
+      m_consolePendingBytes=0;
+      m_consoleSpaceCondition.wakeAll();
+      m_consoleMutex.unlock();
+
+      // the only place a blocked standard stream can wait, producers and the file writer keep going
+      quint64 dropped=m_consoleDropped;
+      if(dropped>droppedReported)
+      {
+         QByteArray note="*** "+QByteArray::number(dropped-droppedReported)+" console messages dropped ***\n";
+         writeAll(2,note.constData(),note.size());
+         droppedReported=dropped;
+      }
+      for(int i=0;i<2;i++)
+      {
+         if(m_consoleBatch[i].isEmpty()) continue;
+         writeAll(i+1,m_consoleBatch[i].constData(),m_consoleBatch[i].size()); // standard output and error descriptors
+         m_consoleBatch[i].resize(0);
       }
 
-      m_customHandlerMutex.lock();
-      QCustomLog::instance().sendLog(now,type,category,message);
-      m_customHandlerMutex.unlock();
+      m_consoleMutex.lock();
    }
+   m_consoleMutex.unlock();
+}
+
+quint64 QCustomLog::enqueueMessage(const QByteArray& line)
+{
+   m_logBufferMutex.lock();
+   qsizetype capacity=m_logBuffer.capacity();
+   m_logBuffer.append(line).append('\n'); m_logBufferMessages++;
+   if(m_logBuffer.capacity()!=capacity) m_bufferGrowths++;
+   if(m_crashRing) { QCustomLog::crashRingWrite(line.constData(),line.size()); QCustomLog::crashRingWrite("\n",1); }
+   quint64 ticket=++m_logBufferTicket;
+   m_logBufferMutex.unlock();
+
+   return ticket;
 }
 
 void QCustomLog::flushBuffer(bool force)
 {
    if(m_logBufferEnabled) QMetaObject::invokeMethod(&QCustomLog::m_logBufferTimer,qOverload<>(&QTimer::start),Qt::QueuedConnection);
 
-   m_logBufferMutex.lock();
-   if(m_logBuffer.isEmpty()) { m_logBufferMutex.unlock(); return; }
+   // file mutex is taken before the swap, so a finished flush guarantees that everything enqueued before its swap is in the file
+   m_logFileMutex.lock();
 
-   if(m_logBufferEnabled && m_logBuffer.count()>m_maxBufferMessages)
+   m_logBufferMutex.lock();
+   if(m_logBuffer.isEmpty())
    {
-      m_maxBufferMessages=m_logBuffer.count();
-      m_logBuffer.reserve(m_maxBufferMessages);
+      quint64 ticket=m_logBufferTicket;
+      m_logBufferMutex.unlock();
+      #ifdef QCUSTOMLOG_IO_URING
+         // earlier messages may still be in flight, their completions mark them as written
+         if(m_uring)
+         {
+            QCustomLog::uringReap(force);
+            if(m_uringCount>0) { m_logFileMutex.unlock(); return; }
+         }
+      #endif
+      m_logFileMutex.unlock();
+      QCustomLog::completeDurability(ticket);
+      return;
    }
 
    // double buffer to avoid blocking the main buffer for a long time
-   // because levels below critical do not cause immediate buffer flushing and their operation will not be slowed down
-   QQueue<QString> doubleBuffer=m_logBuffer;
-   m_logBuffer.clear();
+   // because levels below critical do not cause immediate buffer flushing and their operation will not be slowed down,
+   // both arenas are swapped and keep their capacity, so the buffer grows only until it fits the largest flush interval
+   QByteArray& doubleBuffer=m_logBufferSpare; // protected by the file mutex
+   doubleBuffer.swap(m_logBuffer); quint64 ticket=m_logBufferTicket; qsizetype bufferMessages=m_logBufferMessages;
+   quint64 ringHead=m_crashRing ? reinterpret_cast<CrashRingHeader*>(m_crashRing)->head : 0;
+   m_logBufferMessages=0;
    m_logBufferMutex.unlock();
 
-   m_logFileMutex.lock();
-   if(!QCustomLog::rotateLogFiles(m_logFileName))
+   if(!QCustomLog::rotateLogFiles(m_logFileName))
+   {
+      // extremely rare situation, but it will potentially helps to avoid losing some of logs
+      m_logBufferMutex.lock();
+      doubleBuffer.append(m_logBuffer);
+      doubleBuffer.swap(m_logBuffer); m_logBufferMessages+=bufferMessages;
+      doubleBuffer.resize(0);
+      m_logBufferMutex.unlock();
+      m_logFileMutex.unlock(); // only after restoring, so the next flush keeps the order of messages
+
+      return;
+   }
+
+   #ifdef QCUSTOMLOG_IO_URING
+      // the usual writer below reports the error if the file cannot be opened for the ring
+      if(m_uring && QCustomLog::uringOpen()) { QCustomLog::uringFlush(force,ticket,ringHead,bufferMessages); return; }
+   #endif
+
+   QFile logFile(m_logDir.absoluteFilePath(m_logFileName));
+
+   QElapsedTimer elapsedTimer; elapsedTimer.start();
+   if(!logFile.open(QFile::OpenModeFlag::Text|QFile::OpenModeFlag::WriteOnly|QFile::OpenModeFlag::Append))
+   {
+      QCustomLog::callErrorHandler("Log file \""+m_logFileName+"\" open error: "+logFile.errorString());
+
+      // extremely rare situation, but it will potentially helps to avoid losing some of logs
+      m_logBufferMutex.lock();
+      doubleBuffer.append(m_logBuffer);
+      doubleBuffer.swap(m_logBuffer); m_logBufferMessages+=bufferMessages;
+      doubleBuffer.resize(0);
+      m_logBufferMutex.unlock();
+      m_logFileMutex.unlock(); // only after restoring, so the next flush keeps the order of messages
+
+      return;
+   }
+
+   // the current file continued after a start has no known end yet, so it is taken and the rest of the file is reserved on its first flush
+   if(m_logFileEnd<0) { m_logFileEnd=logFile.size(); if(m_preallocate) QCustomLog::preallocateLogFile(logFile.handle(),m_logFileEnd); }
+
+   qint64 written=qMax(logFile.write(doubleBuffer),(qint64)0); // one write of the whole arena
+   doubleBuffer.resize(0);
+   if(m_logFileEnd>=0) m_logFileEnd+=written;
+   QCustomLog::retentionWritten(written);
+
+   bool sync=QCustomLog::syncDue(force,written);
+
+   float syncElapsed=0.0f;
+   if(sync)
+   {
+      QElapsedTimer syncTimer; syncTimer.start();
+      logFile.flush();
+      if(!QCustomLog::syncLogFile(logFile)) QCustomLog::callErrorHandler("Log file \""+m_logFileName+"\" sync error");
+      syncElapsed=(float)syncTimer.nsecsElapsed()/1e9; // in seconds
+
+      m_unsyncedBytes=0; m_lastSyncTimer.start();
+   }
+
+   logFile.close();
+   float elapsed=(float)elapsedTimer.nsecsElapsed()/1e9-syncElapsed; // in seconds, sync time is measured separately
+
+   if(m_crashRing) reinterpret_cast<CrashRingHeader*>(m_crashRing)->flushed=ringHead;
+
+   m_logFileMutex.unlock();
+
+   QCustomLog::completeDurability(ticket);
+
+   QCustomLog::updateFlushStatistics(bufferMessages,elapsed,sync,syncElapsed);
+}
+
+void QCustomLog::retentionWritten(qint64 written)
+{
+   if(m_janitorThread && !m_retentionLedger.isEmpty())
+   {
+      m_retentionLedger.last().size+=written; m_retentionTotal+=written;
+      if(m_retentionMaxSize>0 && m_retentionTotal>m_retentionMaxSize) m_janitorCondition.wakeOne();
+   }
+}
+
+bool QCustomLog::syncDue(bool force, qint64 written)
+{
+   bool sync=false;
+   switch(m_durability)
+   {
+      case Durability::PeriodicSync:
+         m_unsyncedBytes+=written;
+         if(m_syncSize>0 && m_unsyncedBytes>=m_syncSize) sync=true;
+         if(m_syncInterval>0 && (!m_lastSyncTimer.isValid() || m_lastSyncTimer.elapsed()>=m_syncInterval)) sync=true;
+         break;
+      case Durability::SyncOnCritical:
+         sync=force;
+         break;
+      default: // Durability::None and Durability::FlushToOs
+         break;
+   }
+   return sync;
+}
+
+void QCustomLog::updateFlushStatistics(qsizetype bufferMessages, float elapsed, bool sync, float syncElapsed)
+{
+   // calculate EMA (Exponential Moving Average) for buffer flush time with alpha=0.1
+   float elapsedAvg=m_logBufferFlushTime;
+   if(elapsedAvg<=+0.0f) elapsedAvg=elapsed; else elapsedAvg=(elapsedAvg*0.9f)+(elapsed*0.1f);
+   m_logBufferFlushTime=elapsedAvg;
+
+   QCustomLog::updateAdaptiveSampling(bufferMessages,elapsedAvg);
+
+   if(sync) QCustomLog::updateSyncStatistics(syncElapsed);
+
+   #ifndef NDEBUG
+      if(ConfigReader()->minOutLevel==QtMsgType::QtDebugMsg && !m_cleanLogCategoryIsSet)
+         std::cout << "--- Log buffer flushed in " << elapsed*1e3 << " ms (EMA: " << elapsedAvg*1e3 << " ms)" << std::endl;
+   #endif
+}
+
+void QCustomLog::updateSyncStatistics(float syncElapsed)
+{
+   m_logFileSyncs++;
+
+   // calculate EMA (Exponential Moving Average) for sync time with alpha=0.1
+   float syncElapsedAvg=m_logSyncTime;
+   if(syncElapsedAvg<=+0.0f) syncElapsedAvg=syncElapsed; else syncElapsedAvg=(syncElapsedAvg*0.9f)+(syncElapsed*0.1f);
+   m_logSyncTime=syncElapsedAvg;
+}
+
+bool QCustomLog::setIoUring(bool enabled, quint32 maxInFlight)
+{
+   #if defined(QCUSTOMLOG_IO_URING) && defined(Q_OS_LINUX)
+      m_uringEnabled=enabled; m_uringDepth=qMax(maxInFlight,(quint32)1);
+      if(!enabled) { m_logFileMutex.lock(); QCustomLog::uringExit(); m_logFileMutex.unlock(); } // the usual writer continues the file
+      return true;
+   #else
+      Q_UNUSED(enabled); Q_UNUSED(maxInFlight);
+      return false;
+   #endif
+}
+
+#ifdef QCUSTOMLOG_IO_URING
+void QCustomLog::uringInit()
+{
+   m_logFileMutex.lock();
+   if(!m_uring)
+   {
+      // a sync can follow every write, e.g. io_uring is often disabled in containers, then the usual writer stays
+      m_uring=new io_uring;
+      if(io_uring_queue_init(m_uringDepth*2,m_uring,0)<0) { delete m_uring; m_uring=nullptr; }
+      else m_uringWrites=QVector<UringWrite>(m_uringDepth);
+   }
+   m_logFileMutex.unlock();
+}
+
+void QCustomLog::uringExit()
+{
+   if(!m_uring) return;
+
+   // writes and syncs in flight reference the ring and the arenas, so they are finished first
+   QCustomLog::uringReap(true);
+   if(m_uringFd>=0) { close(m_uringFd); m_uringFd=-1; }
+   io_uring_queue_exit(m_uring); // releases the ring descriptor and its mappings
+   delete m_uring; m_uring=nullptr;
+   m_uringWrites.clear(); m_uringHead=0; m_uringCount=0; m_uringSyncs=0; m_uringSyncStarts.clear();
+   m_uringFileName.clear();
+}
+
+bool QCustomLog::uringOpen()
+{
+   if(m_uringFd>=0 && m_uringFileName==m_logFileName && m_uringGeneration==m_logFileGeneration) return true;
+
+   // writes to the previous file are finished before the file is left, so messages keep their order across files
+   QCustomLog::uringReap(true);
+   if(m_uringFd>=0) { close(m_uringFd); m_uringFd=-1; }
+
+   // no append mode, every write has its own offset because writes in flight are not ordered
+   int fd=open(QFile::encodeName(m_logDir.absoluteFilePath(m_logFileName)).constData(),O_WRONLY|O_CREAT|O_CLOEXEC,0644);
+   if(fd<0) return false;
+   qint64 offset=lseek(fd,0,SEEK_END);
+   if(offset<0) { close(fd); return false; }
+
+   m_uringFd=fd; m_uringFileName=m_logFileName; m_uringGeneration=m_logFileGeneration; m_uringOffset=offset;
+   if(m_logFileEnd<0) { m_logFileEnd=offset; if(m_preallocate) QCustomLog::preallocateLogFile(fd,offset); }
+   return true;
+}
+
+void QCustomLog::uringFlush(bool force, quint64 ticket, quint64 ringHead, qsizetype bufferMessages)
+{
+   QElapsedTimer elapsedTimer; elapsedTimer.start();
+
+   QCustomLog::uringReap(false); // blocks only if all slots are in flight
+
+   // the slot arena with its capacity becomes the spare one, so arenas are still reused
+   UringWrite& write=m_uringWrites[(m_uringHead+m_uringCount)%m_uringWrites.count()];
+   write.data.swap(m_logBufferSpare);
+   write.offset=m_uringOffset; write.ticket=ticket; write.ringHead=ringHead; write.done=false;
+   qint64 written=write.data.size();
+
+   io_uring_sqe* sqe=io_uring_get_sqe(m_uring); // the queue fits a write and a sync of every slot
+   io_uring_prep_write(sqe,m_uringFd,write.data.constData(),(unsigned int)written,(quint64)write.offset);
+   io_uring_sqe_set_data(sqe,&write);
+   m_uringCount++; m_uringOffset+=written;
+
+   if(m_logFileEnd>=0) m_logFileEnd+=written;
+   QCustomLog::retentionWritten(written);
+
+   bool sync=QCustomLog::syncDue(force,written);
+   if(sync)
    {
-      m_logFileMutex.unlock();
-
-      // extremely rare situation, but it will potentially helps to avoid losing some of logs
-      m_logBufferMutex.lock();
-      doubleBuffer.append(m_logBuffer);
-      m_logBuffer=doubleBuffer;
-      m_logBufferMutex.unlock();
+      sqe=io_uring_get_sqe(m_uring);
+      io_uring_prep_fsync(sqe,m_uringFd,IORING_FSYNC_DATASYNC);
+      io_uring_sqe_set_flags(sqe,IOSQE_IO_DRAIN); // starts after all writes submitted before it
+      io_uring_sqe_set_data(sqe,nullptr);
+      m_uringSyncStarts.enqueue(monotonicTimeNs()); // measured on the completion, so syncs that nobody waits for are averaged too
+      m_uringSyncs++;
+      m_unsyncedBytes=0; m_lastSyncTimer.start();
+   }
+   io_uring_submit(m_uring);
 
-      return;
+   // critical messages wait for the same result as with the usual writer
+   float syncElapsed=0.0f;
+   if(force)
+   {
+      QElapsedTimer syncTimer; syncTimer.start();
+      QCustomLog::uringReap(true);
+      if(sync) syncElapsed=(float)syncTimer.nsecsElapsed()/1e9; // in seconds, includes the write
    }
+   float elapsed=(float)elapsedTimer.nsecsElapsed()/1e9-syncElapsed; // in seconds, sync time is measured separately
 
-   QFile logFile(m_logDir.absoluteFilePath(m_logFileName));
+   m_logFileMutex.unlock();
 
-   QElapsedTimer elapsedTimer; elapsedTimer.start();
-   if(!logFile.open(QFile::OpenModeFlag::Text|QFile::OpenModeFlag::WriteOnly|QFile::OpenModeFlag::Append))
+   QCustomLog::updateFlushStatistics(bufferMessages,elapsed,false,0.0f); // the sync time is averaged by uringReap()
+}
+
+void QCustomLog::uringReap(bool drain)
+{
+   while(true)
    {
-      QCustomLog::callErrorHandler("Log file \""+m_logFileName+"\" open error: "+logFile.errorString());
-      m_logFileMutex.unlock();
+      io_uring_cqe* cqe=nullptr;
+      if(drain ? (m_uringCount>0 || m_uringSyncs>0) : (m_uringCount==m_uringWrites.count()))
+      {
+         int result=io_uring_wait_cqe(m_uring,&cqe);
+         if(result==-EINTR) continue;
+         if(result<0) { QCustomLog::callErrorHandler("Log file \""+m_uringFileName+"\" completion wait error"); break; }
+      } else if(io_uring_peek_cqe(m_uring,&cqe)!=0) break;
 
-      // extremely rare situation, but it will potentially helps to avoid losing some of logs
-      m_logBufferMutex.lock();
-      doubleBuffer.append(m_logBuffer);
-      m_logBuffer=doubleBuffer;
-      m_logBufferMutex.unlock();
+      UringWrite* write=static_cast<UringWrite*>(io_uring_cqe_get_data(cqe));
+      int result=cqe->res;
+      io_uring_cqe_seen(m_uring,cqe);
 
-      return;
-   }
+      if(!write)
+      {
+         // syncs complete in the submission order, each one waits for all writes before it
+         m_uringSyncs--;
+         if(!m_uringSyncStarts.isEmpty()) QCustomLog::updateSyncStatistics((float)(monotonicTimeNs()-m_uringSyncStarts.dequeue())/1e9); // in seconds, includes the writes
+         if(result<0) QCustomLog::callErrorHandler("Log file \""+m_uringFileName+"\" sync error");
+         continue;
+      }
+
+      // short writes are rare for regular files, the rest is written directly
+      if(result>=0 && result<write->data.size())
+      {
+         qint64 offset=write->offset+result, size=write->data.size()-result; const char* data=write->data.constData()+result;
+         while(size>0)
+         {
+            ssize_t written=pwrite(m_uringFd,data,size,offset);
+            if(written<0 && errno==EINTR) continue;
+            if(written<=0) { result=-1; break; }
+            data+=written; offset+=written; size-=written;
+         }
+      }
+      if(result<0) QCustomLog::callErrorHandler("Log file \""+m_uringFileName+"\" write error");
+      write->data.resize(0); write->done=true;
 
-   while(!doubleBuffer.isEmpty()) logFile.write(doubleBuffer.dequeue().toUtf8()+'\n');
-   if(force) logFile.flush();
+      // messages are marked as written in the order of the flushes, a later write never overtakes an earlier one
+      while(m_uringCount>0 && m_uringWrites.at(m_uringHead).done)
+      {
+         const UringWrite& head=m_uringWrites.at(m_uringHead);
+         if(m_crashRing) reinterpret_cast<CrashRingHeader*>(m_crashRing)->flushed=head.ringHead;
+         QCustomLog::completeDurability(head.ticket);
+         m_uringHead=(m_uringHead+1)%m_uringWrites.count(); m_uringCount--;
+      }
+   }
+}
+#endif
 
-   logFile.close();
-   float elapsed=(float)elapsedTimer.nsecsElapsed()/1e9; // in seconds
+void QCustomLog::waitForDurability(quint64 ticket)
+{
+   m_durabilityMutex.lock();
+   while(m_durableTicket<ticket)
+   {
+      // another critical caller is already flushing, its flush or the next one will cover this ticket
+      if(m_durabilityFlushActive) { m_durabilityCondition.wait(&m_durabilityMutex); continue; }
 
-   m_logFileMutex.unlock();
+      m_durabilityFlushActive=true;
+      m_durabilityMutex.unlock();
+      QCustomLog::flushBuffer(true);
+      m_durabilityMutex.lock();
+      m_durabilityFlushActive=false;
+      m_durabilityCondition.wakeAll(); // let a follower take over if its ticket is still not covered
 
-   // calculate EMA (Exponential Moving Average) for buffer flush time with alpha=0.1
-   float elapsedAvg=m_logBufferFlushTime;
-   if(elapsedAvg<=+0.0f) elapsedAvg=elapsed; else elapsedAvg=(elapsedAvg*0.9f)+(elapsed*0.1f);
-   m_logBufferFlushTime=elapsedAvg;
+      break; // on a failed flush the error handler is already called and the messages are back in the buffer, do not spin
+   }
+   m_durabilityMutex.unlock();
+}
 
-   #ifndef NDEBUG
-      if(m_minOutLevel==QtMsgType::QtDebugMsg && !m_cleanLogCategoryIsSet)
-         std::cout << "--- Log buffer flushed in " << elapsed*1e3 << " ms (EMA: " << elapsedAvg*1e3 << " ms)" << std::endl;
-   #endif
+void QCustomLog::completeDurability(quint64 ticket)
+{
+   m_durabilityMutex.lock();
+   if(ticket>m_durableTicket) m_durableTicket=ticket;
+   m_durabilityCondition.wakeAll();
+   m_durabilityMutex.unlock();
 }
 
 void QCustomLog::callErrorHandler(const QString& msg)
@@ -262,6 +2015,227 @@ void QCustomLog::normalizePath(QString& path)
    if(!path.endsWith('/')) path.append('/');
 }
 
+bool QCustomLog::syncLogFile(QFile& logFile)
+{
+   #if defined(Q_OS_WIN)
+      return FlushFileBuffers(reinterpret_cast<HANDLE>(_get_osfhandle(logFile.handle())));
+   #elif defined(Q_OS_LINUX)
+      return fdatasync(logFile.handle())==0; // metadata except the size is not needed to read the log back
+   #else
+      return fsync(logFile.handle())==0;
+   #endif
+}
+
+bool QCustomLog::openCrashRing()
+{
+   m_crashRingFile.setFileName(m_logDir.absoluteFilePath(QCoreApplication::applicationName()+".ring"));
+   if(!m_crashRingFile.open(QFile::OpenModeFlag::ReadWrite))
+   {
+      QCustomLog::callErrorHandler("Crash ring file open error: "+m_crashRingFile.errorString());
+      return false;
+   }
+
+   // previous process may have died with unflushed messages
+   if(m_crashRingFile.size()>=(qint64)sizeof(CrashRingHeader)) QCustomLog::recoverCrashRing();
+
+   qint64 fileSize=sizeof(CrashRingHeader)+m_crashRingSize;
+   if(!m_crashRingFile.resize(fileSize) || !(m_crashRing=m_crashRingFile.map(0,fileSize)))
+   {
+      QCustomLog::callErrorHandler("Crash ring file mapping error: "+m_crashRingFile.errorString());
+      m_crashRingFile.close();
+      return false;
+   }
+
+   CrashRingHeader* header=reinterpret_cast<CrashRingHeader*>(m_crashRing);
+   header->magic=m_crashRingMagic; header->capacity=m_crashRingSize;
+   header->head=0; header->flushed=0;
+   return true;
+}
+
+void QCustomLog::recoverCrashRing()
+{
+   qint64 fileSize=m_crashRingFile.size();
+   uchar* mapping=m_crashRingFile.map(0,fileSize);
+   if(!mapping) return;
+
+   const CrashRingHeader* header=reinterpret_cast<const CrashRingHeader*>(mapping);
+   if(header->magic!=m_crashRingMagic || header->capacity!=(quint64)(fileSize-sizeof(CrashRingHeader)) || header->capacity==0 || header->flushed>=header->head)
+   {
+      m_crashRingFile.unmap(mapping);
+      return;
+   }
+
+   // oldest unflushed bytes could be overwritten if the ring is smaller than the buffer
+   quint64 lost=0, start=header->flushed;
+   if(header->head-start>header->capacity) { lost=header->head-header->capacity-start; start=header->head-header->capacity; }
+
+   QByteArray data; data.reserve(header->head-start);
+   for(quint64 i=start;i<header->head;) // at most two chunks because of wrapping
+   {
+      quint64 offset=i%header->capacity, size=qMin(header->head-i,header->capacity-offset);
+      data.append(reinterpret_cast<const char*>(mapping+sizeof(CrashRingHeader)+offset),size);
+      i+=size;
+   }
+   m_crashRingFile.unmap(mapping);
+
+   if(lost>0) data.remove(0,data.indexOf('\n')+1); // first message is incomplete
+   if(data.isEmpty()) return;
+   if(!data.endsWith('\n')) data.append('\n');
+
+   QString notice="Recovered "+QString::number(data.size())+" bytes of unflushed log from the crash ring";
+   if(lost>0) notice.append(", "+QString::number(lost)+" bytes were overwritten");
+
+   QByteArray noticeLine;
+   {
+      ConfigReader config;
+      QDateTime now=config->utcMode ? QDateTime::currentDateTimeUtc() : QDateTime::currentDateTime();
+      FormatScratch scratch;
+      if(m_fileFormat==FileFormat::JsonLines) QCustomLog::formatJsonLine(noticeLine,scratch,currentTimeNs(),config->utcMode,QtMsgType::QtWarningMsg,"QCustomLog",notice,nullptr,reinterpret_cast<quintptr>(QThread::currentThreadId()));
+      else noticeLine=QString(now.toString(config->logMessageFormat)+" [WRN] [QCustomLog] "+notice).toUtf8();
+   }
+
+   QFile logFile(m_logDir.absoluteFilePath(m_logFileName));
+   if(!logFile.open(QFile::OpenModeFlag::WriteOnly|QFile::OpenModeFlag::Append))
+   {
+      QCustomLog::callErrorHandler("Log file \""+m_logFileName+"\" open error: "+logFile.errorString());
+      return;
+   }
+   logFile.write(noticeLine+'\n'+data);
+   logFile.close();
+   m_logFileEnd=-1; // written outside of the flushes
+}
+
+void QCustomLog::crashRingWrite(const char* data, quint64 size)
+{
+   CrashRingHeader* header=reinterpret_cast<CrashRingHeader*>(m_crashRing);
+   uchar* ring=m_crashRing+sizeof(CrashRingHeader);
+
+   // only the tail of a message longer than the ring makes sense
+   if(size>header->capacity) { data+=size-header->capacity; size=header->capacity; }
+
+   quint64 offset=header->head%header->capacity, firstSize=qMin(size,header->capacity-offset);
+   memcpy(ring+offset,data,firstSize);
+   if(size>firstSize) memcpy(ring,data+firstSize,size-firstSize);
+
+   // after copying, so a crash in between does not expose garbage, the fence keeps the compiler and the CPU from moving the store before the copies
+   std::atomic_thread_fence(std::memory_order_release);
+   header->head+=size;
+}
+
+bool QCustomLog::installCrashHandler()
+{
+   #ifdef Q_OS_UNIX
+      if(m_logFileName.isEmpty()) return false;
+
+      // everything the handler touches is allocated here
+      if(!m_crashRing)
+      {
+         quint32 size=m_crashRingSize>0 ? m_crashRingSize : (256*1024);
+         m_crashRing=new uchar[sizeof(CrashRingHeader)+size];
+
+         CrashRingHeader* header=reinterpret_cast<CrashRingHeader*>(m_crashRing);
+         header->magic=m_crashRingMagic; header->capacity=size;
+         m_logBufferMutex.lock(); header->head=0; header->flushed=0; m_logBufferMutex.unlock();
+      }
+      m_crashLogPath[m_crashLogPathIndex]=QFile::encodeName(m_logDir.absoluteFilePath(m_logFileName));
+
+      #ifdef __GLIBC__
+         void* frames[1]; backtrace(frames,1); // the first call loads libgcc, which allocates, so it must not happen inside the handler
+      #endif
+
+      if(!QCustomLog::installThreadCrashStack()) return false;
+
+      struct sigaction action{};
+      action.sa_handler=QCustomLog::crashSignalHandler;
+      sigemptyset(&action.sa_mask);
+      action.sa_flags=SA_ONSTACK|SA_RESETHAND; // default action is restored for re-raising and for crashes inside the handler
+
+      for(int signal:{SIGSEGV,SIGABRT,SIGBUS}) if(sigaction(signal,&action,nullptr)!=0) return false;
+      return true;
+   #else
+      return false;
+   #endif
+}
+
+bool QCustomLog::installThreadCrashStack()
+{
+   #ifdef Q_OS_UNIX
+      // stack overflow is a common reason of SIGSEGV, so the handler needs its own stack in every thread
+      if(m_crashStack.data) return true;
+      const size_t stackSize=64*1024;
+      char* data=new char[stackSize];
+      stack_t stack{}; stack.ss_sp=data; stack.ss_size=stackSize;
+      if(sigaltstack(&stack,nullptr)!=0) { delete[] data; return false; }
+      m_crashStack.data=data;
+      return true;
+   #else
+      return false;
+   #endif
+}
+
+QCustomLog::CrashStack::~CrashStack()
+{
+   #ifdef Q_OS_UNIX
+      if(!data) return;
+      stack_t stack{}; stack.ss_flags=SS_DISABLE;
+      sigaltstack(&stack,nullptr);
+   #endif
+   delete[] data;
+}
+
+#ifdef Q_OS_UNIX
+void QCustomLog::crashSignalHandler(int signal)
+{
+   // only async-signal-safe calls and preallocated memory below
+   if(!m_crashHandling.exchange(true))
+   {
+      int fd=-1;
+      #ifdef QCUSTOMLOG_IO_URING
+         // flushes in flight write at their own offsets and would overwrite an appended report, so it is written after them
+         int uringFd=m_uringFd;
+         if(uringFd>=0) { fd=dup(uringFd); if(fd>=0 && lseek(fd,m_uringOffset,SEEK_SET)<0) { close(fd); fd=-1; } }
+      #endif
+      if(fd<0) fd=open(m_crashLogPath[m_crashLogPathIndex].constData(),O_WRONLY|O_APPEND|O_CREAT|O_CLOEXEC,0644);
+      if(fd>=0)
+      {
+         char number[16]; int pos=sizeof(number);
+         unsigned int value=(unsigned int)signal;
+         do { number[--pos]='0'+(value%10); value/=10; } while(value>0 && pos>0);
+
+         const char prefix[]="*** Crash on signal ";
+         const char suffix[]=", unflushed messages and backtrace follow ***\n";
+         writeAll(fd,prefix,sizeof(prefix)-1);
+         writeAll(fd,number+pos,sizeof(number)-pos);
+         writeAll(fd,suffix,sizeof(suffix)-1);
+
+         // the ring may be in the middle of a write by the crashed thread, an incomplete last message is still better than nothing
+         CrashRingHeader* header=reinterpret_cast<CrashRingHeader*>(m_crashRing);
+         quint64 head=header->head, start=header->flushed;
+         std::atomic_thread_fence(std::memory_order_acquire); // pairs with the fence of crashRingWrite(), which may run on another thread
+         if(head-start>header->capacity) start=head-header->capacity;
+         for(quint64 i=start;i<head;)
+         {
+            quint64 offset=i%header->capacity, size=qMin(head-i,header->capacity-offset);
+            writeAll(fd,reinterpret_cast<const char*>(m_crashRing+sizeof(CrashRingHeader)+offset),size);
+            i+=size;
+         }
+         header->flushed=head; // avoid recovering the same messages again on the next start
+
+         #ifdef __GLIBC__
+            void* frames[64];
+            int count=backtrace(frames,64);
+            backtrace_symbols_fd(frames,count,fd);
+         #endif
+
+         fsync(fd);
+         close(fd);
+      }
+   }
+
+   raise(signal); // handler is already reset to default, so this produces the usual termination and core dump
+}
+#endif
+
 bool QCustomLog::rotateLogFiles(QString& logFileName)
 {
    if(m_logDir.path().isEmpty())
@@ -275,17 +2249,19 @@ bool QCustomLog::rotateLogFiles(QString& logFileName)
 
    QElapsedTimer elapsedTimer; elapsedTimer.start();
 
+   bool dated=(m_rotationPeriod!=RotationPeriod::None);
+   if(dated && !QCustomLog::rotateDatedLogFiles(logFileName)) return false;
+
    // check existing log file size
-   if(!logFileName.isEmpty())
+   if(!dated && !logFileName.isEmpty())
    {
       if(logFileName==mainLogFileName)
       {
-         QFileInfo logFileInfo(m_logDir.absoluteFilePath(logFileName));
-         if(!logFileInfo.exists() || logFileInfo.size()>=m_maxLogFileSize) logFileName.clear();
+         if(QCustomLog::logFileFull(logFileName)) { QCustomLog::releasePreallocation(logFileName); logFileName.clear(); }
       } else logFileName.clear();
    }
 
-   if(logFileName.isEmpty())
+   if(!dated && logFileName.isEmpty())
    {
       QFileInfoList fileList=m_logDir.entryInfoList({QCoreApplication::applicationName()+"_*.log"},QDir::Files);
 
@@ -365,6 +2341,15 @@ bool QCustomLog::rotateLogFiles(QString& logFileName)
 
             // create empty main log file
             if(!QCustomLog::logFileTouch(mainLogFileName)) { logFileName=mainLogFileName; return false; }
+
+            // files were renamed, so the ledger is rebuilt from the list of this rotation instead of tracking every rename
+            if(m_janitorThread)
+            {
+               QFileInfoList files; for(int i=fileList.count()-1;i>=0;i--) files.append(fileList.at(i));
+               files.append(QFileInfo(m_logDir.absoluteFilePath(mainLogFileName)));
+               QCustomLog::retentionRebuild(files);
+               m_janitorCondition.wakeOne();
+            }
          }
       } else if(!QCustomLog::logFileTouch(mainLogFileName)) { logFileName=mainLogFileName; return false; }
    }
@@ -381,16 +2366,219 @@ bool QCustomLog::rotateLogFiles(QString& logFileName)
    }
 
    #ifndef NDEBUG // first call will be inside init and most likely before the clean category is installed, so it should be skipped
-      if(m_minOutLevel==QtMsgType::QtDebugMsg && !m_cleanLogCategoryIsSet && !firstTime)
+      if(ConfigReader()->minOutLevel==QtMsgType::QtDebugMsg && !m_cleanLogCategoryIsSet && !firstTime)
          std::cout << "--- Log files rotate time: " << elapsed*1e3 << " ms (EMA: " << elapsedAvg*1e3 << " ms)" << std::endl;
    #endif
 
    if(firstTime) firstTime=false; // with a check because only in the first call multithreaded recording does not occur
 
-   logFileName=mainLogFileName;
+   if(!dated) logFileName=mainLogFileName;
+   return true;
+}
+
+bool QCustomLog::rotateDatedLogFiles(QString& logFileName)
+{
+   // the deadline is zero before the first call, so the period is computed only at its boundaries
+   qint64 timeNs=currentTimeNs();
+   bool newPeriod=(timeNs>=m_rotationDeadline);
+   if(!newPeriod && !logFileName.isEmpty() && !QCustomLog::logFileFull(logFileName)) return true;
+   if(!logFileName.isEmpty()) QCustomLog::releasePreallocation(logFileName);
+
+   const QString applicationName=QCoreApplication::applicationName();
+   if(newPeriod)
+   {
+      bool utcMode=ConfigReader()->utcMode, hourly=(m_rotationPeriod==RotationPeriod::Hourly);
+      QDateTime now=dateTimeFromNs(timeNs,utcMode);
+      m_rotationStamp=now.toString(hourly ? "yyyy-MM-dd-HH" : "yyyy-MM-dd");
+
+      // the boundary is computed in epoch time, local times are ambiguous in the repeated hour at the end of the daylight saving time,
+      // a daylight saving time change before the boundary moves it by the offset difference, unless that would put it into the past
+      const qint64 period=hourly ? 3600000 : 86400000;
+      qint64 nowMs=timeNs/1000000, offsetMs=now.offsetFromUtc()*1000ll;
+      qint64 deadlineMs=nowMs-(nowMs+offsetMs)%period+period;
+      qint64 shiftedMs=deadlineMs-(dateTimeFromNs(deadlineMs*1000000,utcMode).offsetFromUtc()*1000ll-offsetMs);
+      if(shiftedMs>nowMs) deadlineMs=shiftedMs;
+      m_rotationDeadline=deadlineMs*1000000;
+
+      // continue the last segment of the period, e.g. after a restart
+      const QString prefix=applicationName+"-"+m_rotationStamp+".";
+      m_rotationSegment=0;
+      for(const QString& fileName:m_logDir.entryList({prefix+"*.log"},QDir::Files))
+      {
+         bool ok; int segment=fileName.mid(prefix.size(),fileName.size()-prefix.size()-4).toInt(&ok);
+         if(ok && segment>m_rotationSegment) m_rotationSegment=segment;
+      }
+   }
+
+   QString fileName;
+   while(true)
+   {
+      fileName=applicationName+"-"+m_rotationStamp+"."+QString::number(m_rotationSegment)+".log";
+      QFileInfo logFileInfo(m_logDir.absoluteFilePath(fileName));
+      if(!logFileInfo.exists()) break;
+      if(logFileInfo.size()<m_maxLogFileSize)
+      {
+         if(fileName!=logFileName) { m_logFileEnd=-1; QCustomLog::publishCrashLogPath(fileName); }
+         logFileName=fileName;
+         return true;
+      }
+      m_rotationSegment++;
+   }
+
+   if(!QCustomLog::logFileTouch(fileName)) { logFileName=fileName; return false; }
+   logFileName=fileName;
+   if(m_janitorThread) QCustomLog::retentionAdded(fileName);
+   QCustomLog::publishCrashLogPath(fileName);
+
+   // names are sorted by the period and then numerically by the segment, the oldest files are removed
+   QStringList fileList=m_logDir.entryList({applicationName+"-*.log"},QDir::Files);
+   auto segmentKey=[](const QString& name) { qsizetype dot=name.lastIndexOf('.',name.size()-5); return qMakePair(name.left(dot),name.mid(dot+1,name.size()-dot-5).toInt()); };
+   std::sort(fileList.begin(),fileList.end(),[&segmentKey](const QString& a, const QString& b) { return segmentKey(a)<segmentKey(b); });
+   while(fileList.count()>m_maxLogFiles)
+   {
+      if(!QFile::remove(m_logDir.absoluteFilePath(fileList.first()))) callErrorHandler("Log file \""+fileList.first()+"\" deletion error");
+      else if(m_janitorThread) QCustomLog::retentionRemoved(fileList.first());
+      fileList.removeFirst();
+   }
+
    return true;
 }
 
+void QCustomLog::publishCrashLogPath(const QString& fileName)
+{
+   #ifdef Q_OS_UNIX
+      // the handler keeps reading the active path, so the inactive one is replaced and then published
+      if(!m_crashLogPath[m_crashLogPathIndex].isEmpty())
+      {
+         int inactive=1-m_crashLogPathIndex;
+         m_crashLogPath[inactive]=QFile::encodeName(m_logDir.absoluteFilePath(fileName));
+         m_crashLogPathIndex=inactive;
+      }
+   #else
+      Q_UNUSED(fileName);
+   #endif
+}
+
+quint64 QCustomLog::logFilesSize()
+{
+   m_logFileMutex.lock();
+   quint64 size=m_retentionTotal;
+   m_logFileMutex.unlock();
+   return size;
+}
+
+void QCustomLog::retentionRebuild(const QFileInfoList& files)
+{
+   m_retentionLedger.clear(); m_retentionTotal=0;
+   for(const QFileInfo& fileInfo:files)
+   {
+      m_retentionLedger.append({fileInfo.fileName(),fileInfo.size(),fileInfo.lastModified().toMSecsSinceEpoch()*1000000});
+      m_retentionTotal+=fileInfo.size();
+   }
+}
+
+void QCustomLog::retentionAdded(const QString& fileName)
+{
+   qint64 timeNs=currentTimeNs();
+   if(!m_retentionLedger.isEmpty()) m_retentionLedger.last().modifiedNs=timeNs; // the previous file is not written anymore
+   m_retentionLedger.append({fileName,0,timeNs});
+   m_janitorCondition.wakeOne();
+}
+
+void QCustomLog::retentionRemoved(const QString& fileName)
+{
+   for(int i=0;i<m_retentionLedger.count();i++)
+   {
+      if(m_retentionLedger.at(i).name!=fileName) continue;
+      m_retentionTotal-=m_retentionLedger.at(i).size;
+      m_retentionLedger.removeAt(i);
+      break;
+   }
+}
+
+void QCustomLog::startJanitorThread()
+{
+   m_logFileMutex.lock();
+   if(!m_janitorThread)
+   {
+      // the only full listing, later the ledger follows the written bytes and the rotations
+      const QString applicationName=QCoreApplication::applicationName();
+      QFileInfoList files=m_logDir.entryInfoList({applicationName+"_*.log",applicationName+"-*.log"},QDir::Files,QDir::Time|QDir::Reversed);
+      for(int i=0;i<files.count();i++) // the current file is the last one even if another file was modified later
+      {
+         if(files.at(i).fileName()!=m_logFileName) continue;
+         files.append(files.takeAt(i));
+         break;
+      }
+      QCustomLog::retentionRebuild(files);
+
+      m_janitorStopping=false;
+      m_janitorThread=QThread::create(&QCustomLog::janitorRun);
+      m_janitorThread->start();
+   }
+   m_logFileMutex.unlock();
+}
+
+void QCustomLog::stopJanitorThread()
+{
+   m_logFileMutex.lock();
+   QThread* thread=m_janitorThread;
+   m_janitorStopping=true;
+   m_janitorCondition.wakeAll();
+   m_logFileMutex.unlock();
+
+   if(thread)
+   {
+      thread->wait(); delete thread;
+      m_logFileMutex.lock(); m_janitorThread=nullptr; m_logFileMutex.unlock();
+   }
+}
+
+void QCustomLog::janitorRun()
+{
+   // files retired by a previous process that was stopped before deleting them, removed unlocked because they can be large
+   m_logFileMutex.lock();
+   const QString applicationName=QCoreApplication::applicationName();
+   const QFileInfoList staleFiles=m_logDir.entryInfoList({applicationName+"_*.log.retired",applicationName+"-*.log.retired"},QDir::Files);
+   m_logFileMutex.unlock();
+   for(const QFileInfo& fileInfo:staleFiles)
+      if(!QFile::remove(fileInfo.absoluteFilePath())) callErrorHandler("Log file \""+fileInfo.fileName()+"\" deletion error");
+
+   m_logFileMutex.lock();
+   while(!m_janitorStopping)
+   {
+      // oldest first, the current log file is the last one and is never removed
+      qint64 timeNs=currentTimeNs();
+      while(m_retentionLedger.count()>1)
+      {
+         RetainedFile file=m_retentionLedger.first();
+         bool expired=(m_retentionMaxAge>0 && timeNs-file.modifiedNs>m_retentionMaxAge*1000000);
+         bool overBudget=(m_retentionMaxSize>0 && m_retentionTotal>m_retentionMaxSize);
+         if(!expired && !overBudget) break;
+
+         m_retentionLedger.removeFirst(); m_retentionTotal-=file.size;
+
+         // renaming is quick and keeps the name free for size-based rotation, the slow deletion of a large file is done unlocked
+         QString retiredPath=m_logDir.absoluteFilePath(file.name+".retired");
+         if(!QFile::rename(m_logDir.absoluteFilePath(file.name),retiredPath))
+         {
+            if(QFile::exists(m_logDir.absoluteFilePath(file.name))) callErrorHandler("Log file \""+file.name+"\" deletion error");
+            continue;
+         }
+         m_logFileMutex.unlock();
+         if(!QFile::remove(retiredPath)) callErrorHandler("Log file \""+file.name+"\" deletion error");
+         m_logFileMutex.lock();
+      }
+
+      // without an age limit the thread sleeps until a rotation or an exceeded budget
+      unsigned long timeout=ULONG_MAX;
+      if(m_retentionMaxAge>0 && m_retentionLedger.count()>1)
+         timeout=(unsigned long)qMax((qint64)1000,(m_retentionLedger.first().modifiedNs-timeNs)/1000000+m_retentionMaxAge+1);
+      if(!m_janitorStopping) m_janitorCondition.wait(&m_logFileMutex,timeout);
+   }
+   m_logFileMutex.unlock();
+}
+
 bool QCustomLog::logFileTouch(const QString& fileName)
 {
    QFile newLogFile(m_logDir.absolutePath()+"/"+fileName);
@@ -399,10 +2587,123 @@ bool QCustomLog::logFileTouch(const QString& fileName)
       callErrorHandler("Log file \""+fileName+"\" creation error");
       return false;
    }
+   m_logFileEnd=0; if(m_preallocate) QCustomLog::preallocateLogFile(newLogFile.handle(),0);
    newLogFile.close();
+   m_logFileGeneration++; // a new file may have the name of the current one
    return true;
 }
 
+bool QCustomLog::logFileFull(const QString& fileName)
+{
+   // the tracked end saves a file status call per flush, with preallocation the file size would not even show it
+   if(m_logFileEnd>=0) return m_logFileEnd>=m_maxLogFileSize;
+
+   QFileInfo logFileInfo(m_logDir.absoluteFilePath(fileName));
+   return !logFileInfo.exists() || logFileInfo.size()>=m_maxLogFileSize;
+}
+
+void QCustomLog::preallocateLogFile(int fd, qint64 offset)
+{
+   #ifdef Q_OS_LINUX
+      // the size is kept, so readers and the append mode see only the written data, errors only mean a usual growing file
+      if(fd>=0 && offset<m_maxLogFileSize) fallocate(fd,FALLOC_FL_KEEP_SIZE,offset,m_maxLogFileSize-offset);
+   #else
+      Q_UNUSED(fd); Q_UNUSED(offset);
+   #endif
+}
+
+void QCustomLog::releasePreallocation(const QString& fileName)
+{
+   // truncation to the logical end frees the reserved blocks beyond it
+   if(m_preallocate && m_logFileEnd>=0 && !fileName.isEmpty()) QFile::resize(m_logDir.absoluteFilePath(fileName),m_logFileEnd);
+   m_logFileEnd=-1;
+}
+
+void QCustomLog::closeLogFile()
+{
+   m_logFileMutex.lock();
+   #ifdef QCUSTOMLOG_IO_URING
+      QCustomLog::uringExit();
+   #endif
+   QCustomLog::releasePreallocation(m_logFileName);
+   m_logFileMutex.unlock();
+}
+
+const char* QCustomLog::internContextString(const char* string)
+{
+   if(!string) return nullptr;
+   QByteArray key=QByteArray::fromRawData(string,qstrlen(string)); // lookup without allocation
+
+   m_contextStringsLock.lockForRead();
+   auto it=m_contextStrings.constFind(key);
+   const char* interned=(it!=m_contextStrings.constEnd()) ? it->constData() : nullptr;
+   m_contextStringsLock.unlock();
+   if(interned) return interned;
+
+   m_contextStringsLock.lockForWrite();
+   it=m_contextStrings.constFind(key);
+   if(it==m_contextStrings.constEnd()) it=m_contextStrings.insert(QByteArray(string)); // deep copy, the string may be temporary, its data never moves
+   interned=it->constData();
+   m_contextStringsLock.unlock();
+   return interned;
+}
+
+QCustomLog::CategoryInfo* QCustomLog::internCategory(const char* name)
+{
+   if(!name) name="";
+   QByteArray key=QByteArray::fromRawData(name,qstrlen(name)); // lookup without allocation
+
+   m_categoriesLock.lockForRead();
+   CategoryInfo* category=m_categories.value(key,nullptr);
+   m_categoriesLock.unlock();
+   if(category) return category;
+
+   m_categoriesLock.lockForWrite();
+   category=m_categories.value(key,nullptr);
+   if(!category)
+   {
+      category=new CategoryInfo;
+      category->name=QString::fromUtf8(name);
+      category->utf8Name=QByteArray(name); // deep copy, the name may be temporary
+      m_categories.insert(category->utf8Name,category);
+   }
+   m_categoriesLock.unlock();
+   return category;
+}
+
+void QCustomLog::computeRoutes(CategoryInfo* category)
+{
+   // concurrent computations under the read lock produce the same result, so no extra locking is needed
+   quint64 generation=m_routesGeneration;
+   const QtMsgType levels[5]={QtMsgType::QtDebugMsg,QtMsgType::QtInfoMsg,QtMsgType::QtWarningMsg,QtMsgType::QtCriticalMsg,QtMsgType::QtFatalMsg};
+
+   for(QtMsgType level:levels)
+   {
+      quint64 route=0;
+      for(int i=-1;i<m_sinks.count();i++)
+      {
+         const QCustomLogSink* sink=(i<0) ? &m_fileSink : m_sinks.at(i);
+         if(!QCustomLog::levelGreaterOrEqual(level,sink->m_minLevel)) continue;
+         if(!sink->m_categories.isEmpty() && !sink->m_categories.contains(category->name)) continue;
+         route|=(1ull<<(i+1));
+      }
+      category->routes[QCustomLog::levelIndex(level)]=route;
+   }
+   category->generation=generation;
+}
+
+int QCustomLog::levelIndex(QtMsgType level)
+{
+   switch(level)
+   {
+      case QtMsgType::QtDebugMsg: return 0;
+      case QtMsgType::QtInfoMsg: return 1;
+      case QtMsgType::QtWarningMsg: return 2;
+      case QtMsgType::QtCriticalMsg: return 3;
+      default: return 4; // QtMsgType::QtFatalMsg
+   }
+}
+
 bool QCustomLog::levelGreaterOrEqual(QtMsgType level, QtMsgType minLevel)
 {
    // this is necessary because different versions of qt have different order of QtMsgType enum
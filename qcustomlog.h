@@ -21,20 +21,51 @@
 #include <QLoggingCategory>
 #include <QElapsedTimer>
 #include <atomic>
+#include <type_traits>
+#include <initializer_list>
 #include <QString>
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
+#include <QSharedPointer>
 #include <QQueue>
 #include <QTimer>
 #include <QMutex>
+#include <QWaitCondition>
+#include <QReadWriteLock>
+#include <QThread>
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QPair>
+#include <QFileSystemWatcher>
 #include <QDebug>
 
 #ifndef NDEBUG
    #include <iostream>
 #endif
 
+#ifdef QCUSTOMLOG_IO_URING
+   struct io_uring; // liburing is included only by the implementation
+#endif
+
 #define _qclog_GET_MACRO(_1,_2,NAME,...) NAME
 
+/**
+ * @brief Logging category of the call site
+ * @details A function-local static of a lambda, so every call site registers its category once like Q_LOGGING_CATEGORY, not on every message
+ * @attention The category must be a string literal or another constant name, QLoggingCategory keeps the pointer and the first name of the call site is used
+ */
+#define _qclog_siteCategory(c)         ([]() -> const QLoggingCategory& { static const QLoggingCategory _qclog_siteCategoryStatic(c); return _qclog_siteCategoryStatic; }())
+
+/**
+ * @brief Log message if the level of the category is enabled
+ * @details The same check as qCDebug() and others, the message is not built and the handler is not called for disabled levels,
+ *          the if-else form keeps the macros usable as single statements and in an unbraced if-else
+ */
+#define _qclog_logEnabled(f,t,c,x)     if(const QLoggingCategory& _qclog_logCategory=_qclog_siteCategory(c); !_qclog_logCategory.isEnabled(t)) {} else f(_qclog_logCategory).noquote() << x
+
 /**
  * @brief Log debug message macro
  * @details Log debug message with or without category
@@ -44,8 +75,8 @@
  */
 #define logDebug(...)                  _qclog_GET_MACRO(__VA_ARGS__,_qclog_logDebugWCat,_qclog_logDebug)(__VA_ARGS__)
 #ifndef NDEBUG
-   #define _qclog_logDebug(x)          qDebug(QLoggingCategory(_qclog_category)).noquote() << x
-   #define _qclog_logDebugWCat(x,c)    qDebug(QLoggingCategory(c)).noquote() << x
+   #define _qclog_logDebug(x)          _qclog_logEnabled(qDebug,QtMsgType::QtDebugMsg,_qclog_category,x)
+   #define _qclog_logDebugWCat(x,c)    _qclog_logEnabled(qDebug,QtMsgType::QtDebugMsg,c,x)
 #else
    #define _qclog_logDebug(x)          ((void)0)
    #define _qclog_logDebugWCat(x,c)    ((void)0)
@@ -58,8 +89,8 @@
  * @attention This macro requires _qclog_category with the category name to be defined before use
  */
 #define logInfo(...)                   _qclog_GET_MACRO(__VA_ARGS__,_qclog_logInfoWCat,_qclog_logInfo)(__VA_ARGS__)
-#define _qclog_logInfo(x)              qInfo(QLoggingCategory(_qclog_category)).noquote() << x
-#define _qclog_logInfoWCat(x,c)        qInfo(QLoggingCategory(c)).noquote() << x
+#define _qclog_logInfo(x)              _qclog_logEnabled(qInfo,QtMsgType::QtInfoMsg,_qclog_category,x)
+#define _qclog_logInfoWCat(x,c)        _qclog_logEnabled(qInfo,QtMsgType::QtInfoMsg,c,x)
 
 /**
  * @brief Log warning message macro
@@ -68,8 +99,8 @@
  * @attention This macro requires _qclog_category with the category name to be defined before use
  */
 #define logWarning(...)                _qclog_GET_MACRO(__VA_ARGS__,_qclog_logWarningWCat,_qclog_logWarning)(__VA_ARGS__)
-#define _qclog_logWarning(x)           qWarning(QLoggingCategory(_qclog_category)).noquote() << x
-#define _qclog_logWarningWCat(x,c)     qWarning(QLoggingCategory(c)).noquote() << x
+#define _qclog_logWarning(x)           _qclog_logEnabled(qWarning,QtMsgType::QtWarningMsg,_qclog_category,x)
+#define _qclog_logWarningWCat(x,c)     _qclog_logEnabled(qWarning,QtMsgType::QtWarningMsg,c,x)
 
 /**
  * @brief Log critical message macro
@@ -78,8 +109,8 @@
  * @attention This macro requires _qclog_category with the category name to be defined before use
  */
 #define logCritical(...)               _qclog_GET_MACRO(__VA_ARGS__,_qclog_logCriticalWCat,_qclog_logCritical)(__VA_ARGS__)
-#define _qclog_logCritical(x)          qCritical(QLoggingCategory(_qclog_category)).noquote() << x
-#define _qclog_logCriticalWCat(x,c)    qCritical(QLoggingCategory(c)).noquote() << x
+#define _qclog_logCritical(x)          _qclog_logEnabled(qCritical,QtMsgType::QtCriticalMsg,_qclog_category,x)
+#define _qclog_logCriticalWCat(x,c)    _qclog_logEnabled(qCritical,QtMsgType::QtCriticalMsg,c,x)
 
 /**
  * @brief Log fatal message macro
@@ -91,26 +122,350 @@
  */
 #define logFatal(...)                  _qclog_GET_MACRO(__VA_ARGS__,_qclog_logFatalWCat,_qclog_logFatal)(__VA_ARGS__)
 #if QT_VERSION >= QT_VERSION_CHECK(6,5,0)
-   #define _qclog_logFatal(x)          qFatal(QLoggingCategory(_qclog_category)).noquote() << x
-   #define _qclog_logFatalWCat(x,c)    qFatal(QLoggingCategory(c)).noquote() << x
+   #define _qclog_logFatal(x)          qFatal(_qclog_siteCategory(_qclog_category)).noquote() << x
+   #define _qclog_logFatalWCat(x,c)    qFatal(_qclog_siteCategory(c)).noquote() << x
 #else
    #define _qclog_logFatal(x)          qFatal(x)
    #define _qclog_logFatalWCat(x,c)    qFatal(x)
 #endif
 
+/**
+ * @brief Log structured messages macros
+ * @details Log message with a category and typed key-value fields, e.g. logInfoKV("DB","query done",{"ms",elapsed},{"rows",n})
+ * @param c Category, a string literal or another constant name
+ * @param x Message
+ * @param ... Fields as {key,value} pairs, keys must be string literals or otherwise outlive the message
+ * @details Fields are stored typed and serialized only by the outputs, the file and standard outputs append them to the message as key=value pairs
+ * @details If NDEBUG is defined, then debug messages will not be processed because of performance reasons
+ */
+#define logInfoKV(c,x,...)             _qclog_logKV(qInfo,QtMsgType::QtInfoMsg,c,x,__VA_ARGS__)
+#define logWarningKV(c,x,...)          _qclog_logKV(qWarning,QtMsgType::QtWarningMsg,c,x,__VA_ARGS__)
+#define logCriticalKV(c,x,...)         _qclog_logKV(qCritical,QtMsgType::QtCriticalMsg,c,x,__VA_ARGS__)
+#ifndef NDEBUG
+   #define logDebugKV(c,x,...)         _qclog_logKV(qDebug,QtMsgType::QtDebugMsg,c,x,__VA_ARGS__)
+#else
+   #define logDebugKV(c,x,...)         ((void)0)
+#endif
+#define _qclog_logKV(f,t,c,x,...)      do { const QLoggingCategory& _qclog_kvCategory=_qclog_siteCategory(c); if(_qclog_kvCategory.isEnabled(t)) { \
+                                          const QCustomLogFieldsScope _qclog_kvScope({__VA_ARGS__}); f(_qclog_kvCategory).noquote() << x; } } while(0)
+
+/**
+ * @brief Typed key-value field of a structured log message
+ * @details Values are stored typed and serialized only by the outputs, strings are implicitly shared without copying
+ */
+struct QCustomLogField
+{
+   enum class Type { Int, UInt, Double, Bool, String }; /**< Value types */
+
+   template<typename T,typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value,int>::type=0>
+   QCustomLogField(const char* key, T value) : key(key), type(Type::Int), intValue(value) {} /**< Signed integer field */
+   template<typename T,typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value && !std::is_same<T,bool>::value,int>::type=0>
+   QCustomLogField(const char* key, T value) : key(key), type(Type::UInt), uintValue(value) {} /**< Unsigned integer field */
+   QCustomLogField(const char* key, double value) : key(key), type(Type::Double), doubleValue(value) {} /**< Floating point field */
+   QCustomLogField(const char* key, bool value) : key(key), type(Type::Bool), boolValue(value) {} /**< Boolean field */
+   QCustomLogField(const char* key, const QString& value) : key(key), type(Type::String), intValue(0), stringValue(value) {} /**< String field */
+   QCustomLogField(const char* key, const char* value) : key(key), type(Type::String), intValue(0), stringValue(QString::fromUtf8(value)) {} /**< UTF-8 string field */
+
+   const char* key; /**< Field key */
+   Type type; /**< Value type */
+   union
+   {
+      qint64 intValue; /**< Value for Type::Int */
+      quint64 uintValue; /**< Value for Type::UInt */
+      double doubleValue; /**< Value for Type::Double */
+      bool boolValue; /**< Value for Type::Bool */
+   };
+   QString stringValue; /**< Value for Type::String */
+
+   /**
+    * @brief Append fields as text
+    * @details Fields are separated by spaces in the key=value form, strings with spaces, quotes or equal signs are quoted
+    * @param out Output string
+    * @param fields Fields to append
+    */
+   static void appendText(QString& out, const QList<QCustomLogField>& fields);
+
+   /**
+    * @brief Append fields as JSON object members
+    * @details Every member is prefixed by a comma, so the fields can be appended after other members of an object
+    * @param out Output UTF-8 buffer
+    * @param fields Fields to append
+    */
+   static void appendJson(QByteArray& out, const QList<QCustomLogField>& fields);
+
+   /**
+    * @brief Append fields in binary form
+    * @details Format is the fields count (uint16), then for every field the key length (uint8), the key, the type (uint8) and
+    *          an 8-byte little-endian value or the UTF-8 length (uint32) and bytes for strings
+    * @param out Output buffer
+    * @param fields Fields to append
+    */
+   static void appendBinary(QByteArray& out, const QList<QCustomLogField>& fields);
+};
+
+/**
+ * @brief Structured log message fields scope
+ * @details Makes the fields available to the message handler for messages of the current thread during the scope, used by the *KV logging macros
+ */
+class QCustomLogFieldsScope
+{
+   public:
+      QCustomLogFieldsScope(std::initializer_list<QCustomLogField> fields); /**< Publishes the fields for the current thread */
+      ~QCustomLogFieldsScope(); /**< Restores the previous fields of the current thread */
+
+   private:
+      QCustomLogFieldsScope(const QCustomLogFieldsScope&)=delete; /**< Prohibit copy constructor */
+      QCustomLogFieldsScope& operator=(const QCustomLogFieldsScope&)=delete; /**< Prohibit copy assignment */
+
+      QList<QCustomLogField> m_fields; /**< Fields storage */
+      const QList<QCustomLogField>* m_previous; /**< Previous fields of the current thread */
+};
+
+/**
+ * @brief Log record passed to the sinks
+ */
+struct QCustomLogRecord
+{
+   qint64 time; /**< Message time in nanoseconds since the epoch */
+   QtMsgType type; /**< Message level */
+   QString category; /**< Message category */
+   QString message; /**< Message text, debug messages include the source prefix */
+   quintptr threadId; /**< Id of the thread that logged the message */
+   QList<QCustomLogField> fields; /**< Typed fields of a structured message, message text does not include them */
+};
+
+/**
+ * @brief Log record view
+ * @details Passed to QCustomLog::sendRecord(), members refer to the buffers of the message being logged and are valid only during the call
+ */
+struct QCustomLogRecordView
+{
+   qint64 time; /**< Message time in nanoseconds since the epoch */
+   QtMsgType type; /**< Message level */
+   const QString& category; /**< Message category */
+   const QString& message; /**< Message text with the fields as text, debug messages include the source prefix, the same as passed to sendLog() */
+   const QList<QCustomLogField>* fields; /**< Typed fields of a structured message or nullptr */
+   quintptr threadId; /**< Id of the thread that logged the message */
+   const QByteArray& formattedLine; /**< UTF-8 line in the text log file format without the line break and colors */
+   bool utcMode; /**< UTC time mode the message was formatted with */
+};
+
+/**
+ * @brief Asynchronous log sink
+ * @details Sink receives records in batches on its own worker thread, so a slow destination like a database does not throttle the logging threads
+ * @details Records are dropped when the sink queue is full, dropped records and the average latency are counted per sink
+ * @attention Remove the sink with QCustomLog::removeSink() before destroying it, otherwise debug builds assert and release builds drop its queued records
+ */
+class QCustomLogSink
+{
+   public:
+      /**
+       * @brief Get dropped records count
+       * @return Number of records dropped because the sink queue was full
+       * @details This method is thread-safe
+       */
+      quint64 droppedRecords() const { return m_droppedRecords; }
+
+      /**
+       * @brief Get average sink latency
+       * @return Average time from logging a record to the end of its batch write in seconds
+       * @details This method is thread-safe
+       */
+      float averageLatency() const { return m_latency; }
+
+      /**
+       * @brief Set sink filter
+       * @details Routing decisions are cached per category and recomputed after the filter change, so rejected records cost nothing for the sink
+       * @param minLevel Minimum level of records passed to the sink, default is QtMsgType::QtDebugMsg
+       * @param categories Categories passed to the sink, default is empty which means all categories
+       * @details This method is thread-safe
+       */
+      void setFilter(QtMsgType minLevel, const QStringList& categories=QStringList());
+
+   protected:
+      /**
+       * @brief Construct sink
+       * @param queueSize Maximum number of queued records, default is 8192, the queue is preallocated with 256 bytes per record
+       * @param maxBatchSize Maximum number of records passed to a single @see writeRecords() call, default is 256
+       */
+      explicit QCustomLogSink(quint32 queueSize=8192, quint32 maxBatchSize=256) : m_queueSize(qMax(queueSize,1u)), m_maxBatchSize(qMax(maxBatchSize,1u)) {}
+      virtual ~QCustomLogSink(); /**< Polymorphic destructor, unregisters a sink that was not removed and drops its queued records */
+
+      /**
+       * @brief Write records batch
+       * @details Called on the sink worker thread only, records are in the logging order, e.g. for a multi-row database insert
+       * @param records Records batch
+       */
+      virtual void writeRecords(const QList<QCustomLogRecord>& records)=0;
+
+   private:
+      friend class QCustomLog;
+
+      QCustomLogSink(const QCustomLogSink&)=delete; /**< Prohibit copy constructor */
+      QCustomLogSink& operator=(const QCustomLogSink&)=delete; /**< Prohibit copy assignment */
+
+      struct Slot /**< Queue slot of 256 bytes with Qt 6 on 64-bit platforms, short messages are stored inline, so they never touch the heap between the logging thread and the sink */
+      {
+         qint64 time; /**< Message time in nanoseconds since the epoch */
+         QtMsgType type; /**< Message level */
+         quintptr threadId; /**< Id of the thread that logged the message */
+         QString category; /**< Interned category name, shared without allocation */
+         QString overflow; /**< Message that does not fit the inline storage, null if the message is inline */
+         QList<QCustomLogField> fields; /**< Typed fields */
+         quint16 size; /**< Size of the inline message */
+         char text[158]; /**< Inline message encoded as UTF-8 */
+      };
+
+      static void fillSlot(Slot& slot, qint64 time, QtMsgType type, const QString& category, const QString& message,
+                           const QList<QCustomLogField>* fields, quintptr threadId); /**< Fills a slot once for all sinks, the message is encoded inline if it fits */
+
+      void start(); /**< Starts the worker thread */
+      void stop(); /**< Stops the worker thread after writing all queued records */
+      void enqueue(const Slot& slot); /**< Copies a slot to the queue or drops it if the queue is full */
+      void run(); /**< Worker thread loop */
+
+      const quint32 m_queueSize; /**< Maximum number of queued records */
+      const quint32 m_maxBatchSize; /**< Maximum batch size */
+
+      QMutex m_queueMutex; /**< Mutex for the queue and the worker state */
+      QWaitCondition m_queueCondition; /**< Wakes the worker on new records or stop */
+      QVector<Slot> m_slots; /**< Preallocated ring of queue slots */
+      quint32 m_head=0; /**< Index of the oldest queued slot */
+      quint32 m_count=0; /**< Number of queued slots */
+      QThread* m_worker=nullptr; /**< Worker thread */
+      bool m_stopping=false; /**< Worker stop is requested */
+      bool m_discarding=false; /**< Queued records are dropped on stop, because the derived sink is already destroyed */
+
+      QtMsgType m_minLevel=QtMsgType::QtDebugMsg; /**< Minimum level, protected by the sinks lock */
+      QStringList m_categories; /**< Accepted categories, empty means all, protected by the sinks lock */
+
+      std::atomic<quint64> m_droppedRecords=0; /**< Dropped records count */
+      std::atomic<float> m_latency=0.0f; /**< Average latency in seconds */
+};
+
+/**
+ * @brief Built-in file sink
+ * @details Represents the buffered log file writer in the sinks registry, e.g. to set its filter,
+ *          its records are written by the buffer flush with the group commit instead of a worker thread
+ */
+class QCustomLogFileSink final : public QCustomLogSink
+{
+   private:
+      friend class QCustomLog;
+
+      QCustomLogFileSink() : QCustomLogSink(1,1) {} /**< Only QCustomLog creates the instance */
+      void writeRecords(const QList<QCustomLogRecord>& records) override {} /**< Never called, the worker is not started */
+};
+
 class QCustomLog
 {
    public:
       using ErrorHandler=void (*)(const QString&); /**< Error handler type */
 
+      /**
+       * @brief Durability modes of the log file
+       * @details Defines how far written messages are pushed towards the stable storage
+       */
+      enum class Durability
+      {
+         None, /**< Critical messages are buffered like other ones and written by the next timed flush, the logging thread never waits for the file */
+         FlushToOs, /**< Critical messages are written to the operating system before the logging call returns, default */
+         PeriodicSync, /**< The data is synced to the stable storage when the sync interval or the sync size is reached */
+         SyncOnCritical /**< Critical messages sync the data to the stable storage */
+      };
+
+      /**
+       * @brief Rate limit bucket keys
+       */
+      enum class RateLimitKey
+      {
+         Category, /**< One token bucket per category, default */
+         SourceLocation /**< One token bucket per call site, the category is used if the message context has no source location, e.g. in release builds */
+      };
+
+      /**
+       * @brief Log file formats
+       */
+      enum class FileFormat
+      {
+         Text, /**< Human-readable text, the same as the standard output without colors, default */
+         JsonLines /**< One JSON object per line with time, level, category, thread, message and structured fields members */
+      };
+
+      /**
+       * @brief Time-based log rotation periods
+       */
+      enum class RotationPeriod
+      {
+         None, /**< Rotation only by the maximum file size, files are named with the application name and a number, default */
+         Hourly, /**< New file every hour, e.g. "App-2025-01-01-13.0.log" */
+         Daily /**< New file every day, e.g. "App-2025-01-01.0.log" */
+      };
+
+      /**
+       * @brief Standard output streams of console messages
+       */
+      enum class ConsoleStream
+      {
+         StdErr, /**< All messages to the standard error, the same as the default Qt message handler, default */
+         StdOut, /**< All messages to the standard output */
+         Split /**< Debug and information messages to the standard output, warnings and critical messages to the standard error */
+      };
+
+      /**
+       * @brief Overflow policies of the asynchronous console output
+       */
+      enum class ConsoleOverflow
+      {
+         DropNewest, /**< New lines are dropped and counted while the pending lines exceed the limit, default */
+         Block /**< Logging threads wait for the console thread, the same as the synchronous output but with batching */
+      };
+
+      /**
+       * @brief Overflow policies of the deferred formatting queue
+       */
+      enum class DeferredOverflow
+      {
+         Block, /**< Logging threads wait for a free slot, no message is lost, default */
+         DropNewest /**< New messages are dropped and counted while the queue is full, so a logging thread never waits for the formatting thread to queue them */
+      };
+
       /**
        * @brief Set custom log instance
        * @details Custom log instance is used to override a @see sendLog() function, for example to send somewhere like a database
        * @param instance Custom log instance pointer
        * @attention Call this method before creating threads and starting the application event loop
+       * @details Messages logged by the overrided @see sendLog() are written to the other outputs but are not passed to it again
+       * @attention Reset the instance with setInstance(nullptr) before destroying it, logging itself is shut down with the QCoreApplication
        */
       static void setInstance(QCustomLog* instance) { m_customInstance=instance; }
 
+      /**
+       * @brief Add asynchronous sink
+       * @details Sink receives records that would be passed to @see sendLog() and pass its filter, its worker thread is started here
+       * @param sink Sink pointer, ownership is not transferred
+       * @return Result of the operation
+       * @retval true Sink was added or is already added
+       * @retval false Sink was not added because of the limit of 63 sinks
+       * @details This method is thread-safe
+       */
+      static bool addSink(QCustomLogSink* sink);
+
+      /**
+       * @brief Remove asynchronous sink
+       * @details Sink worker thread writes all queued records and stops before this method returns
+       * @param sink Sink pointer
+       * @details This method is thread-safe
+       */
+      static void removeSink(QCustomLogSink* sink);
+
+      /**
+       * @brief Get built-in file sink
+       * @details File sink is a part of the sinks registry, its filter can be set the same way as for other sinks
+       * @return File sink pointer
+       */
+      static QCustomLogSink* fileSink() { return &m_fileSink; }
+
       /**
        * @brief Set error handler
        * @details Error handler will be called in case of logging errors, useful for debugging or force closing the application
@@ -126,6 +481,7 @@ class QCustomLog
        * @return Result of the operation
        * @retval true Timestamp format was set successfully
        * @retval false Timestamp format was not set, e.g. invalid format string
+       * @details This method is thread-safe and can be called at runtime
        */
       static bool setTimestampFormat(const QString& format);
 
@@ -133,13 +489,13 @@ class QCustomLog
        * @brief Set minimum log levels
        * @details Only messages with a level greater than or equal to the minimum output level will be output to standard output or file
        * @param outLevel Minimum standard output level, default is QtMsgType::QtDebugMsg
-       * @param fileLevel Minimum file output level, default is QtMsgType::QtDebugMsg
+       * @param fileLevel Minimum file output level, default is QtMsgType::QtDebugMsg, applied together with the file sink filter
        * @attention Messages with QtDebugMsg level will be processed only if compiled in debug mode, regardless of the minimum log levels
        *            Messages with a QtFatalMsg processed always, regardless of the minimum log levels
        * @attention Minimum standard output level will be ignored if clean log category is set
-       * @attention Call this method before creating threads and starting the application event loop
+       * @details This method is thread-safe and can be called at runtime
        */
-      static void setMinLevels(QtMsgType outLevel, QtMsgType fileLevel) { m_minOutLevel=outLevel; m_minOutFileLevel=fileLevel; }
+      static void setMinLevels(QtMsgType outLevel, QtMsgType fileLevel);
 
       /**
        * @brief Set clean log category
@@ -148,18 +504,54 @@ class QCustomLog
        * @param category Clean log category name
        * @param writeToFile Write clean log category messages to file and overrided sendLog(), default is true
        * @attention If clean log category is set then minimum standard output level will be ignored
-       * @attention Call this method before creating threads and starting the application event loop
+       * @details Replaces the clean log categories routed to the standard output, empty category name removes them, see @see addCleanCategory()
+       * @details This method is thread-safe and can be called at runtime
        * @attention If automation deals with sensitive data like keys or secrets, it is STRONGLY recommended to set writeToFile to false
        */
-      static void setCleanLogCategory(const QString& category, bool writeToFile=true) {
-         if(category.isEmpty()) m_cleanLogCategoryIsSet=false; else m_cleanLogCategoryIsSet=true;
-         m_cleanLogCategory=category; m_cleanToFile=writeToFile; }
+      static void setCleanLogCategory(const QString& category, bool writeToFile=true);
+
+      /**
+       * @brief Add clean log category
+       * @details Messages of every clean log category are written without any formatting to the output of the category,
+       *          so several machine-readable streams, e.g. CI output, progress and metrics, can be produced at once
+       * @details Routing is evaluated once per category and settings change and cached in the interned category
+       * @param category Clean log category name
+       * @param outputFile Output file of the category, messages are appended to it, empty path means the standard output, default is empty
+       * @param writeToFile Write messages of the category to the log file and overrided sendLog(), default is true
+       * @return Result of the operation
+       * @retval true Clean log category was added or its route was replaced
+       * @retval false Clean log category was not added, e.g. the output file cannot be opened or has no file descriptor, which is the case on Windows
+       * @attention Other messages are not written to the standard output while any clean log category is routed to it
+       * @details This method is thread-safe and can be called at runtime
+       */
+      static bool addCleanCategory(const QString& category, const QString& outputFile=QString(), bool writeToFile=true);
+
+      /**
+       * @brief Add clean log category routed to a file descriptor
+       * @details The same as @see addCleanCategory() with an output file, e.g. for a pipe inherited from a CI runner, the descriptor is not closed
+       * @param category Clean log category name
+       * @param fd Open file descriptor
+       * @param writeToFile Write messages of the category to the log file and overrided sendLog(), default is true
+       * @return Result of the operation
+       * @retval true Clean log category was added or its route was replaced
+       * @retval false Clean log category was not added, e.g. the descriptor is negative
+       * @details This method is thread-safe and can be called at runtime
+       */
+      static bool addCleanCategory(const QString& category, int fd, bool writeToFile=true);
+
+      /**
+       * @brief Remove clean log category
+       * @details Messages of the category are logged as usual again, its output file is closed
+       * @param category Clean log category name
+       * @details This method is thread-safe and can be called at runtime
+       */
+      static void removeCleanCategory(const QString& category);
 
       /**
        * @brief Check if clean log category is set
        * @return Result of the check
-       * @retval true Clean log category is set
-       * @retval false Clean log category is not set
+       * @retval true Any clean log category is set
+       * @retval false No clean log category is set
        * @details This method is fast and thread-safe
        */
       static bool haveCleanCategory() { return m_cleanLogCategoryIsSet; }
@@ -168,8 +560,296 @@ class QCustomLog
        * @brief Set UTC time mode
        * @details If UTC time mode is set, then all log messages will be written in UTC time
        * @param utcMode UTC time mode
+       * @details This method is thread-safe and can be called at runtime
+       */
+      static void setUtcMode(bool utcMode);
+
+      /**
+       * @brief Set the standard stream of console messages
+       * @details Console messages are written directly to the stream descriptor, concurrent messages are batched into one write.
+       * Colors are used only if the stream is a terminal
+       * @param stream Standard stream, default is ConsoleStream::StdErr
+       * @details This method is thread-safe and can be called at runtime
+       */
+      static void setConsoleStream(ConsoleStream stream);
+
+      /**
+       * @brief Set asynchronous console output
+       * @details Console lines are written by a dedicated thread, so a stalled standard stream, e.g. a pipe of a blocked log collector,
+       * does not block logging threads and the log file output. The number of dropped lines is written to the standard error when the stream recovers
+       * @param enabled Asynchronous console output, default is false
+       * @param maxPendingBytes Maximum size of lines waiting for the console thread, default is 1 MB
+       * @param overflow Policy when the limit is reached, default is ConsoleOverflow::DropNewest
+       * @attention Call this method before @see initLogging()
+       */
+      static void setAsyncConsole(bool enabled, quint32 maxPendingBytes=(1024*1024), ConsoleOverflow overflow=ConsoleOverflow::DropNewest) {
+         m_consoleAsync=enabled; m_consoleMaxBytes=qMax(maxPendingBytes,1024u); m_consoleOverflow=overflow; }
+
+      /**
+       * @brief Get dropped console messages count
+       * @return Number of console lines dropped by the asynchronous console output because of the limit
+       * @details This method is thread-safe
+       */
+      static quint64 consoleDroppedMessages() { return m_consoleDropped; }
+
+      /**
+       * @brief Set deferred formatting
+       * @details Logging threads only capture the time, level, interned category, source location and message into a queue,
+       *          and a formatting thread builds the timestamps, tags, debug prefixes and JSON lines and writes them to all outputs,
+       *          so latency-critical threads spend almost no time in logging
+       * @details Critical and fatal messages are still formatted by the logging thread after the queued messages are written, so their durability is kept,
+       *          a thread logging them waits for the formatting thread with either overflow policy, at most for a full queue,
+       *          an overrided sendLog() is called on the formatting thread for deferred messages
+       * @details The queue slots are allocated when the formatting thread starts, source files and functions are interned on their first use,
+       *          so queueing a message does not allocate
+       * @details The number of dropped messages is logged as a warning by the formatting thread once the queue has space again
+       * @param enabled Deferred formatting, default is false
+       * @param queueSize Maximum number of raw messages waiting for the formatting thread, default is 65536
+       * @param overflow Policy when the queue is full, default is DeferredOverflow::Block
+       * @attention Call this method before @see initLogging()
+       */
+      static void setDeferredFormatting(bool enabled, quint32 queueSize=65536, DeferredOverflow overflow=DeferredOverflow::Block) {
+         m_deferredFormatting=enabled; m_deferredQueueSize=qMax(queueSize,1u); m_deferredOverflow=overflow; }
+
+      /**
+       * @brief Get dropped deferred messages count
+       * @return Number of messages dropped by deferred formatting because of a full queue with DeferredOverflow::DropNewest
+       * @details This method is thread-safe
+       */
+      static quint64 deferredDroppedMessages() { return m_deferredDropped; }
+
+      /**
+       * @brief Set log file durability mode
+       * @details Sync means fdatasync() on Linux, fsync() on other POSIX systems and FlushFileBuffers() on Windows
+       * @param mode Durability mode, default is Durability::FlushToOs
+       * @param syncInterval Minimum time between syncs in milliseconds for Durability::PeriodicSync, default is 1000 ms, 0 disables the time trigger
+       * @param syncSize Amount of written data in bytes that triggers a sync for Durability::PeriodicSync, default is 1 MB, 0 disables the size trigger
+       * @details Periodic sync conditions are checked on buffer flushes, so the effective interval is not less than the buffer flush time
+       * @attention Call this method before creating threads and starting the application event loop
+       */
+      static void setDurability(Durability mode, quint32 syncInterval=1000, quint32 syncSize=(1024*1024)) {
+         m_durability=mode; m_syncInterval=syncInterval; m_syncSize=syncSize; }
+
+      /**
+       * @brief Set rate limit
+       * @details Token bucket rate limiting is evaluated before any message formatting, suppressed messages are counted and summarized
+       *          with a warning like "Suppressed 19834 similar messages" at most every 5 seconds, before the next allowed message of the bucket,
+       *          and for ended floods on the next allowed message of any bucket or by a timer of the thread that called initLogging(), even without buffering
+       * @details Buckets are kept in the interned categories, so messages of different categories do not contend
+       * @param rate Allowed messages per second of each bucket, default is 0 which means that rate limiting is disabled
+       * @param burst Bucket size, i.e. number of messages allowed at once, default is 0 which means the same as the rate
+       * @param key Bucket key, default is RateLimitKey::Category
+       * @details Critical and fatal messages are never rate limited
+       * @details This method is thread-safe and can be called at runtime, existing buckets are reset
+       */
+      static void setRateLimit(quint32 rate, quint32 burst=0, RateLimitKey key=RateLimitKey::Category);
+
+      /**
+       * @brief Set category rate limit
+       * @details Overrides the rate limit set by @see setRateLimit() for the category, the bucket key is the same
+       * @param category Category name
+       * @param rate Allowed messages per second, 0 removes the override
+       * @param burst Bucket size, default is 0 which means the same as the rate
+       * @details This method is thread-safe and can be called at runtime, existing buckets are reset
+       */
+      static void setCategoryRateLimit(const QString& category, quint32 rate, quint32 burst=0);
+
+      /**
+       * @brief Set duplicate messages coalescing
+       * @details Repeats of a message with the same category, level and text within the window are not logged, but counted and collapsed
+       *          into one record with the original text and the repeated, first and last fields when the window ends or another message breaks the run
+       * @param window Coalescing window in milliseconds, default is 0 which means that coalescing is disabled
+       * @param consecutiveOnly Coalesce only consecutive repeats within a category, default is false which means any repeats within the window
+       * @details Fatal messages are never coalesced, summaries of the ended windows are also logged on timed buffer flushes
+       *          and by a timer of the thread that called initLogging(), even without buffering
+       * @details Windows are measured by the monotonic clock, so wall clock steps do not stretch them, and the state is kept per category,
+       *          so messages of different categories do not contend
+       * @details This method is thread-safe and can be called at runtime
+       */
+      static void setCoalescing(quint32 window, bool consecutiveOnly=false);
+
+      /**
+       * @brief Set category sampling rate
+       * @details Only a random subset of debug and information messages of the category is kept, sampling is evaluated before any formatting
+       * @param category Category name, empty name sets the default rate of categories without their own rate
+       * @param rate Kept fraction of messages from 0.0 to 1.0, e.g. 0.1 keeps 1 of 10 messages, 1.0 removes the sampling
+       * @details This method is thread-safe and can be called at runtime
+       */
+      static void setSampling(const QString& category, double rate);
+
+      /**
+       * @brief Set category rules
+       * @details Rules are "pattern=level" pairs separated by semicolons or line breaks, e.g. "net.*=warning;net.http.client=debug",
+       *          a pattern is an exact category name, a prefix ending with ".*" or "*" for all categories, the most specific pattern wins
+       * @details Rules are evaluated once per category and rules change, and are also applied by a QLoggingCategory filter, so the logging macros
+       *          skip disabled levels before the message is built, categories without a matching rule keep the decisions of the previous filter, e.g. QT_LOGGING_RULES
+       * @details The logging macros of this library keep a static QLoggingCategory per call site, so a disabled level costs one branch there,
+       *          as with Q_LOGGING_CATEGORY and qCDebug()
+       * @param rules Category rules, levels are debug, info, warning, critical and off, empty string removes all rules
+       * @return Result of the parsing
+       * @retval true All rules are valid
+       * @retval false Some rules are invalid, they are skipped and the valid ones are applied
+       * @details Fatal messages are never filtered
+       * @details This method is thread-safe and can be called at runtime
+       */
+      static bool setCategoryRules(const QString& rules);
+
+      /**
+       * @brief Set adaptive sampling
+       * @details On every buffer flush the sampling rates of debug and information messages of all categories are halved if the buffer fill
+       *          or the average buffer flush time is above its threshold, and doubled back up to the configured rates otherwise
+       * @param maxBufferMessages Buffer fill threshold in messages, 0 disables this trigger
+       * @param maxFlushTime Average buffer flush time threshold in seconds, 0 disables this trigger
+       * @details Adaptive sampling is disabled if both triggers are disabled, which is the default
+       * @details This method is thread-safe and can be called at runtime
+       */
+      static void setAdaptiveSampling(quint32 maxBufferMessages, float maxFlushTime);
+
+      /**
+       * @brief Get effective sampling rates
+       * @return Effective kept fractions of debug and information messages by category, including adaptive tightening,
+       *         the empty category name holds the default rate
+       * @details This method is thread-safe
+       */
+      static QHash<QString,double> samplingRates();
+
+      /**
+       * @brief Watch config file
+       * @details The INI file is loaded now and reloaded when it changes, including replacement by editors, settings are applied on the event loop thread
+       *          and snapshot settings are switched at once, e.g.
+       * @code
+       * [General]
+       * outputLevel=warning ; debug, info, warning or critical
+       * fileLevel=debug
+       * timestampFormat=yyyy.MM.dd HH:mm:ss.zzz
+       * utc=false
+       * cleanCategory=CI
+       * cleanToFile=true
+       *
+       * [Sampling]
+       * default=0.5 ; see setSampling()
+       * NET=0.05
+       *
+       * [RateLimit]
+       * NET=100 ; see setCategoryRateLimit()
+       *
+       * [Categories]
+       * net.*=warning ; see setCategoryRules()
+       * net.http.client=debug
+       * @endcode
+       * @details Missing General keys keep their current values, removed sampling and rate limit categories are reset, invalid values are reported and skipped
+       * @details The whole file is applied as one snapshot, so messages never see a partially applied file, category names may contain "/", e.g. "CI/CD"
+       * @param path Config file path, empty path stops watching
+       * @return Result of the initial load
+       * @retval true Config file was loaded and is watched
+       * @retval false Config file was not loaded, e.g. it does not exist or has a format error, it is still watched if the path is not empty
+       * @attention Call this method from a thread with an event loop, e.g. the main thread
+       */
+      static bool watchConfigFile(const QString& path);
+
+      /**
+       * @brief Set log file format
+       * @details JSON lines are produced by a built-in escaping serializer without intermediate JSON documents
+       * @param format Log file format, default is FileFormat::Text
+       * @param epochTime JSON time member is the integer number of nanoseconds since the epoch instead of an ISO 8601 string with the UTC offset, default is false
+       * @attention Call this method before initLogging()
+       */
+      static void setFileFormat(FileFormat format, bool epochTime=false) { m_fileFormat=format; m_jsonEpochTime=epochTime; }
+
+      /**
+       * @brief Set time-based log rotation period
+       * @details Log files are named with the start of their period in local or UTC time according to the UTC mode,
+       *          a file reaching the maximum size continues in the next numbered segment of the same period, so files are never renamed
+       * @details The end of the current period is cached, so flushes only compare the current time with it
+       * @param period Rotation period, default is RotationPeriod::None
+       * @attention Call this method before initLogging()
+       * @attention The maximum number of log files still applies, the oldest periods are removed first
+       */
+      static void setRotationPeriod(RotationPeriod period) { m_rotationPeriod=period; }
+
+      /**
+       * @brief Set log files retention
+       * @details Limits the total size and the age of log files in addition to their maximum number, the oldest files are removed by a background thread
+       * @details Sizes are tracked in memory from the written bytes, the log directory is listed only on start and on size-based rotation
+       * @details Files are renamed with the .retired suffix before their deletion, such files left by a stopped process are removed on start
+       * @param maxTotalSize Maximum total size of log files in bytes, 0 means no limit, default is 0
+       * @param maxAge Maximum time in milliseconds since the last write to a log file, 0 means no limit, default is 0
+       * @attention Call this method before initLogging()
+       * @attention The current log file is never removed, so the total size can exceed the limit by up to the maximum file size
+       */
+      static void setRetention(quint64 maxTotalSize, qint64 maxAge=0) { m_retentionMaxSize=maxTotalSize; m_retentionMaxAge=maxAge; }
+
+      /**
+       * @brief Get total size of log files
+       * @return Total size of log files in bytes tracked by the retention, 0 if the retention is not set
+       * @details This method is thread-safe
+       */
+      static quint64 logFilesSize();
+
+      /**
+       * @brief Set log files preallocation
+       * @details Every new log file gets disk space up to the maximum file size reserved at once, without changing its size,
+       *          so appends do not allocate blocks one by one and files are less fragmented
+       * @details The end of the current file is tracked in memory and the unused reserved space is released on rotation and on shutdown
+       * @param enabled Preallocation of log files, default is false
+       * @attention Call this method before initLogging()
+       * @attention Only Linux is supported, other platforms and file systems without the support ignore the reservation
+       */
+      static void setPreallocation(bool enabled) { m_preallocate=enabled; }
+
+      /**
+       * @brief Set io_uring log file writer
+       * @details Buffer flushes submit the write and the sync of the log file to io_uring and return without waiting in write(2),
+       *          up to the maximum number of flushes can be in flight, their messages are marked as written in the order of the flushes
+       * @details Critical messages keep their durability, the caller waits until its flush is written and synced if the durability mode requires it
+       * @param enabled io_uring log file writer, default is false
+       * @param maxInFlight Maximum number of flushes in flight, default is 4, minimum is 1
+       * @return io_uring log file writer support
+       * @retval true Built on Linux with QCUSTOMLOG_IO_URING defined and liburing linked, the usual writer is used if the ring cannot be created
+       * @retval false Not supported, the usual writer is used
+       * @details The crash handler writes its report after the flushes in flight, their messages are also in the report, as it cannot know which of them complete
+       * @details The ring is destroyed on shutdown or when the writer is disabled, after the flushes in flight complete, the usual writer then continues the file
+       * @attention Call this method before initLogging() to enable the writer
+       * @attention Build with QCUSTOMLOG_IO_URING defined and link liburing, e.g. "DEFINES += QCUSTOMLOG_IO_URING" and "LIBS += -luring" in qmake,
+       *            or "target_compile_definitions(app PRIVATE QCUSTOMLOG_IO_URING)" and "target_link_libraries(app PRIVATE uring)" in CMake
+       */
+      static bool setIoUring(bool enabled, quint32 maxInFlight=4);
+
+      /**
+       * @brief Set crash ring size
+       * @details Crash ring is a memory-mapped file in the log directory, every message written to the buffer is also copied into it without system calls,
+       *          so the operating system keeps it even if the process crashes before the buffer is flushed
+       * @details Unflushed messages found in the crash ring are recovered into the log file on the next initLogging()
+       * @param size Crash ring size in bytes, default is 0 which means that the crash ring is disabled, minimum is 64 KB
+       * @attention Call this method before initLogging()
        */
-      static void setUtcMode(bool utcMode) { m_utcMode=utcMode; }
+      static void setCrashRingSize(quint32 size) { if(size==0 || size>=(64*1024)) m_crashRingSize=size; else m_crashRingSize=(64*1024); }
+
+      /**
+       * @brief Install crash handler
+       * @details Crash handler catches SIGSEGV, SIGABRT and SIGBUS, writes unflushed messages and a backtrace to the log file and re-raises the signal for the default core dump
+       * @details Only preallocated memory and async-signal-safe system calls are used, unflushed messages are taken from the crash ring,
+       *          a memory-only one is allocated if the crash ring file is disabled, see @see setCrashRingSize()
+       * @return Result of the installation
+       * @retval true Crash handler was installed
+       * @retval false Crash handler was not installed, e.g. the platform is not POSIX or logging is not initialized
+       * @details Backtrace is written only on glibc based systems
+       * @attention Call this method after initLogging() and before creating threads
+       * @attention The alternate signal stack is installed only for the calling thread, other threads need @see installThreadCrashStack()
+       *            to report their stack overflows, other crashes of any thread are reported without it
+       */
+      static bool installCrashHandler();
+
+      /**
+       * @brief Install crash handler stack for the current thread
+       * @details Signal handlers run on the stack of the crashed thread, so a thread without its own alternate stack cannot report a stack overflow,
+       *          the stack is released when the thread exits
+       * @return Result of the installation
+       * @retval true Alternate signal stack is installed for the current thread or was already installed
+       * @retval false Alternate signal stack was not installed, e.g. the platform is not POSIX
+       * @attention Call this method at the start of every thread that should report stack overflows, @see installCrashHandler() does it for its thread
+       */
+      static bool installThreadCrashStack();
 
       /**
        * @brief Get average buffer flush time
@@ -178,6 +858,21 @@ class QCustomLog
        */
       static float averageBufferFlushTime() { return m_logBufferFlushTime; }
 
+      /**
+       * @brief Get average log file sync time
+       * @return Average log file sync time in seconds, it is not included in the average buffer flush time
+       * @details Syncs of the io_uring writer are measured from their submission to their completion, including the writes submitted before them
+       * @details This method is thread-safe
+       */
+      static float averageSyncTime() { return m_logSyncTime; }
+
+      /**
+       * @brief Get log file syncs count
+       * @return Number of log file syncs since the start, a group commit of concurrent critical messages is one sync
+       * @details This method is thread-safe
+       */
+      static quint64 logFileSyncs() { return m_logFileSyncs; }
+
       /**
        * @brief Get average log files rotation time
        * @return Average log rotation time in seconds
@@ -185,6 +880,17 @@ class QCustomLog
        */
       static float averageRotationTime() { return m_logRotationTime; }
 
+      /**
+       * @brief Get buffer growths count
+       * @return Number of times the log buffer arena or the per-thread formatting buffers had to grow
+       * @details The count stops growing once the buffers fit the largest flush interval and messages, text and JSON lines, clean lines and timestamps
+       *          are formatted into them, the timestamp text is rebuilt once per second and only its milliseconds are rewritten per message
+       * @details Allocations that remain are not counted: the message text built by QDebug before the handler, debug prefixes, typed fields,
+       *          the timestamp once per millisecond with other sub-second fields than "zzz", and the strings asynchronous sinks receive on their threads
+       * @details This method is thread-safe
+       */
+      static quint64 bufferGrowths() { return m_bufferGrowths; }
+
       /**
        * @brief Initialize logging
        * @details Set log files directory and install message handler
@@ -195,7 +901,10 @@ class QCustomLog
        * @return Result of the initialization
        * @retval true Initialization was successful
        * @retval false Initialization failed, e.g. log directory is not writable
-       * @details Messages with a critical level or higher cause the buffer to be flushed to a file immediately
+       * @details Messages with a critical level or higher cause the buffer to be flushed to a file immediately, except critical messages with Durability::None
+       * @details Concurrent critical messages are group-committed, one flush writes everything queued before it and releases all waiting callers
+       * @details Logging is shut down when the QCoreApplication is destroyed: the default message handler is restored, the buffer is flushed,
+       *          the formatting, console and janitor threads are stopped and the log file is closed
        * @attention Call this method before creating threads and starting the application event loop
        * @attention Disabling the buffering is strongly not recommended, as it can cause a disk performance serious drop
        */
@@ -213,37 +922,360 @@ class QCustomLog
       static void messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& msg);
 
    private:
+      friend class QCustomLogSink;
+      friend class QCustomLogFieldsScope;
+
+      struct RateLimit /**< Token bucket parameters */
+      {
+         double rate; /**< Tokens per second */
+         double burst; /**< Bucket size */
+      };
+      struct TokenBucket /**< Token bucket state */
+      {
+         double tokens; /**< Available tokens */
+         qint64 refillTime; /**< Last refill time in nanoseconds of the monotonic clock */
+         qint64 summaryTime; /**< Last summary time in nanoseconds of the monotonic clock */
+         quint64 suppressed; /**< Suppressed messages since the last summary */
+         QByteArray file; /**< Bucket source file for RateLimitKey::SourceLocation, a copy because the message context is temporary */
+         int line; /**< Bucket source line for RateLimitKey::SourceLocation */
+      };
+
+      struct CoalescedMessage /**< Run of repeated messages */
+      {
+         quint64 hash; /**< Hash of the level and text */
+         QtMsgType type; /**< Message level */
+         QString message; /**< Message text */
+         QByteArray file; /**< Source file of the first message, a copy because the message context is temporary */
+         int line; /**< Source line of the first message */
+         QByteArray function; /**< Source function of the first message, a copy because the message context is temporary */
+         qint64 firstTime; /**< First message time in nanoseconds since the epoch */
+         qint64 lastTime; /**< Last repeat time in nanoseconds since the epoch */
+         qint64 windowStart; /**< First message time in nanoseconds of the monotonic clock, the window is measured from it */
+         quint64 repeats; /**< Repeats after the first message */
+      };
+
+      struct CategoryInfo /**< Interned category with cached routing decisions */
+      {
+         QString name; /**< Category name */
+         QByteArray utf8Name; /**< Category name for message contexts */
+         std::atomic<quint64> samplingGeneration=0; /**< Sampling generation the threshold is computed for */
+         std::atomic<quint64> samplingThreshold=0; /**< Kept messages have a 32-bit random number below it, 2^32 keeps all */
+         std::atomic<quint64> generation=0; /**< Routes generation the routes are computed for */
+         std::atomic<quint64> routes[5]={}; /**< Bit masks of accepting sinks per level, bit 0 is the file sink */
+         std::atomic<quint64> rulesGeneration=0; /**< Category rules generation the rule level is computed for */
+         std::atomic<int> ruleLevel=-1; /**< Minimum level index of the matching category rule, -1 if no rule matches */
+         std::atomic<quint64> cleanRoute=0; /**< Lower 32 bits of the snapshot generation in the upper half, 0 or ((fd+2)<<1)|toFile of the clean route in the lower one */
+         QMutex rateMutex; /**< Mutex for the token buckets of the category, messages of other categories never contend for it */
+         quint64 rateGeneration=0; /**< Rate limits generation the buckets are reset for, protected by the rate mutex */
+         RateLimit rateLimit={0.0,0.0}; /**< Rate limit of the category, protected by the rate mutex */
+         bool rateBySource=false; /**< Buckets are kept per source location, protected by the rate mutex */
+         TokenBucket rateBucket={0.0,0,0,0,QByteArray(),0}; /**< Bucket of the category, protected by the rate mutex */
+         QHash<QPair<QByteArray,int>,TokenBucket> sourceBuckets; /**< Buckets by source file and line, protected by the rate mutex */
+         QMutex coalesceMutex; /**< Mutex for the coalescing state of the category, messages of other categories never contend for it */
+         QHash<quint64,CoalescedMessage> coalesced; /**< Tracked messages by hash, or the last message under key 0 in the consecutive mode, protected by the coalesce mutex */
+      };
+
+      struct CleanRoute /**< Output of a clean log category */
+      {
+         int fd; /**< Output file descriptor, -1 means the standard output */
+         bool toFile; /**< Clean log category to file flag */
+         QSharedPointer<QFile> file; /**< Output file owned by the snapshots routing to it, closed with the last of them */
+      };
+
+      struct Config /**< Immutable snapshot of the settings read on every message */
+      {
+         quint64 generation=0; /**< Incremented on every update, identifies the snapshot for the per-category caches */
+         QtMsgType minOutLevel=QtMsgType::QtDebugMsg; /**< Minimum output level */
+         QHash<QString,CleanRoute> cleanRoutes; /**< Routes of clean log categories */
+         bool cleanConsole=false; /**< Any clean log category is routed to the standard output */
+         QString logMessageFormat="'['yyyy.MM.dd HH:mm:ss.zzz']'"; /**< Log message timestamp format */
+         bool utcMode=false; /**< UTC time flag */
+         ConsoleStream consoleStream=ConsoleStream::StdErr; /**< Standard stream of console messages */
+         QHash<QString,int> categoryRules; /**< Minimum level indexes by category name, prefix with ".*" or "*", 4 means off */
+         QtMsgType fileLevel=QtMsgType::QtDebugMsg; /**< Minimum file output level */
+         QHash<QString,double> samplingRates; /**< Configured sampling rates by category */
+         double samplingDefault=1.0; /**< Configured default sampling rate */
+         RateLimit rateLimit={0.0,0.0}; /**< Default rate limit, zero rate means disabled */
+         RateLimitKey rateLimitKey=RateLimitKey::Category; /**< Bucket key */
+         QHash<QString,RateLimit> categoryRateLimits; /**< Per category rate limits */
+
+         Config() {} /**< User-provided, so the default snapshot can be defined inside the class */
+      };
+
+      struct DeferredMessage /**< Raw message captured by a logging thread for the formatting thread */
+      {
+         qint64 time; /**< Message time in nanoseconds since the epoch */
+         QtMsgType type; /**< Message level */
+         CategoryInfo* category; /**< Interned category */
+         const char* file; /**< Interned source file of the message context, the context may be freed when the logging call returns */
+         const char* function; /**< Interned function of the message context, the context may be freed when the logging call returns */
+         QString message; /**< Message text */
+         QList<QCustomLogField> fields; /**< Typed fields */
+         quintptr threadId; /**< Id of the thread that logged the message */
+      };
+
+      struct FormatScratch /**< Per-thread formatting buffers reused by all messages of the thread */
+      {
+         QString text; /**< Formatted message */
+         QByteArray utf8; /**< Formatted message encoded as UTF-8 */
+         QByteArray json; /**< Message formatted as a JSON line */
+         QByteArray clean; /**< Clean message line encoded as UTF-8 */
+         QString stamp; /**< Cached timestamp text, its milliseconds are rewritten in place */
+         QString stampFormat; /**< Timestamp format of the cached text */
+         qsizetype stampField=-1; /**< Position of the three-digit milliseconds field in the format, -1 without sub-second fields, -2 with other ones */
+         qsizetype stampMsPos=-1; /**< Position of the milliseconds in the cached text, -1 if it has none */
+         qint64 stampKey=-1; /**< Second of the cached text, or its millisecond with other sub-second fields */
+         bool stampUtc=false; /**< UTC time mode of the cached text */
+         QByteArray iso; /**< Cached ISO 8601 time of JSON lines, its milliseconds are rewritten in place */
+         qsizetype isoMsPos=-1; /**< Position of the milliseconds in the cached ISO time */
+         qint64 isoSecond=-1; /**< Second of the cached ISO time */
+         bool isoUtc=false; /**< UTC time mode of the cached ISO time */
+         bool reserved=false; /**< Buffers capacity is reserved */
+         bool inUse=false; /**< Buffers are used by the message being formatted */
+
+         FormatScratch() {} /**< User-provided, so the per-thread buffers can be defined inside the class */
+      };
+
+      struct ReaderCounters /**< Readers counters of a thread, on their own cache line, so readers of different threads never share one */
+      {
+         alignas(64) std::atomic<quint32> readers[2]={}; /**< Readers of the even and odd epochs */
+         bool inUse=false; /**< Counters belong to a running thread, protected by the readers mutex */
+      };
+      struct ReaderCountersRelease /**< Returns the counters of an exiting thread for reuse */
+      {
+         bool armed=false; /**< Counters of the thread are acquired */
+
+         ReaderCountersRelease() {} /**< User-provided, so the destructor is registered on the first use in a thread */
+         ~ReaderCountersRelease();
+      };
+
+      class ConfigReader /**< Lock-free read access to the current snapshot, the snapshot is not deleted while any reader of it exists */
+      {
+         public:
+            ConfigReader();
+            ~ConfigReader() { m_counters->readers[m_slot]--; }
+            const Config* operator->() const { return m_config; }
+
+         private:
+            ConfigReader(const ConfigReader&)=delete; /**< Prohibit copy constructor */
+            ConfigReader& operator=(const ConfigReader&)=delete; /**< Prohibit copy assignment */
+
+            ReaderCounters* m_counters; /**< Readers counters of the current thread */
+            quint32 m_slot; /**< Readers counter slot of the epoch */
+            const Config* m_config; /**< Snapshot */
+      };
+
       QCustomLog(const QCustomLog&)=delete; /**< Prohibit copy constructor */
       QCustomLog& operator=(const QCustomLog&)=delete; /**< Prohibit copy assignment */
 
+      template<typename F> static void updateConfig(F update) /**< Publishes a modified copy of the snapshot and retires the previous one without waiting for its readers */
+      {
+         m_configMutex.lock();
+         const Config* previous=m_config;
+         Config* config=new Config(*previous); update(*config);
+         config->generation=previous->generation+1;
+         config->cleanConsole=false; for(const CleanRoute& route:config->cleanRoutes) if(route.fd<0) config->cleanConsole=true;
+         m_samplingEnabled=(config->samplingDefault<1.0 || !config->samplingRates.isEmpty() || m_adaptiveMaxMessages>0 || m_adaptiveMaxFlushTime>0.0f);
+         m_rateLimitEnabled=(config->rateLimit.rate>0.0 || !config->categoryRateLimits.isEmpty());
+         m_config=config;
+         m_utcMode=config->utcMode; m_cleanLogCategoryIsSet=!config->cleanRoutes.isEmpty();
+         QCustomLog::retireConfig(previous);
+         m_configMutex.unlock();
+      }
+
       static QCustomLog& instance() /**< Singleton with custom inheritor support */
       {
          static QCustomLog defaultInstance;
          return m_customInstance ? *m_customInstance : defaultInstance;
       }
 
-      static void flushBuffer() { QCustomLog::flushBuffer(false); }; /**< Overloaded method for internal purposes */
+      static void flushBuffer() { QCustomLog::logSuppressedSummaries(false); QCustomLog::logCoalescedSummaries(false); QCustomLog::flushBuffer(false); }; /**< Overloaded method for internal purposes */
       static void flushBuffer(bool force=false); /**< Flushes log buffer to file with optional force flush */
+      static void shutdownLogging(); /**< Flushes everything and stops the logging threads, a post routine of the QCoreApplication */
+      static CategoryInfo* internCategory(const char* name); /**< Returns the interned category, creating it on the first use */
+      static const char* internContextString(const char* string); /**< Returns the interned copy of a message context string, copying it on the first use */
+      static void computeRoutes(CategoryInfo* category); /**< Computes routing decisions of the category, must be called with locked sinks lock */
+      static inline int levelIndex(QtMsgType level); /**< Returns the level index independent of the QtMsgType enum order */
+      static void formatJsonLine(QByteArray& line, FormatScratch& scratch, qint64 timeNs, bool utcMode, QtMsgType type, const QString& category, const QString& message,
+                                 const QList<QCustomLogField>* fields, quintptr threadId); /**< Formats a message as a JSON line without the line break into the reused line */
+      static void formatStamp(FormatScratch& scratch, const QString& format, qint64 timeNs, bool utcMode); /**< Updates the cached timestamp text of the scratch buffers */
+      static void writeMessage(QtMsgType type, CategoryInfo* categoryInfo, const char* file, const char* function, const QString& msg,
+                               const QList<QCustomLogField>* fields, qint64 timeNs, quintptr threadId); /**< Formats a message with the current snapshot and writes it to all outputs */
+      static void sendToInstance(const QCustomLogRecordView& record); /**< Passes a record to the custom instance unless the current thread is already inside it */
+      static int categoryRuleLevel(CategoryInfo* category); /**< Returns the cached minimum level index of the category rules, -1 if no rule matches */
+      static void categoryFilter(QLoggingCategory* category); /**< QLoggingCategory filter applying the category rules after the previous filter */
+      static bool samplingAllows(CategoryInfo* category); /**< Decides if a debug or information message of the category is kept */
+      static void applySampling(Config& config, const QString& category, double rate); /**< Sets the sampling rate of the category in the snapshot being updated */
+      static void applyRateLimit(Config& config, const QString& category, quint32 rate, quint32 burst); /**< Sets the rate limit of the category in the snapshot being updated */
+      static bool compileCategoryRules(const QString& rules, QHash<QString,int>& compiled); /**< Parses category rules, returns false if some rules are invalid */
+      static void categoryRulesChanged(); /**< Makes categories and the QLoggingCategory filter reevaluate the rules of a published snapshot */
+      static void updateAdaptiveSampling(qsizetype bufferMessages, float flushTime); /**< Tightens or relaxes sampling according to the flush load */
+      static bool rateLimitAllows(CategoryInfo* category, const QMessageLogContext& context, qint64 monotonicNs, quint64& suppressed,
+                                  QByteArray& file, int& line); /**< Takes a token from the message bucket at the monotonic time, returns the suppressed count to summarize with the bucket location */
+      static void logSuppressedSummaries(bool all); /**< Logs summaries of buckets with suppressed messages, only of those without a recent summary if not all */
+      static void logSuppressed(const QByteArray& category, const QByteArray& file, int line, quint64 suppressed); /**< Logs a summary of suppressed messages */
+      static bool coalesceAllows(CategoryInfo* category, QtMsgType type, const QMessageLogContext& context, const QString& msg, qint64 timeNs); /**< Counts repeats of the message, returns false if it is a repeat */
+      static void logCoalescedSummaries(bool all); /**< Logs summaries of coalesced messages, only of the ended windows if not all */
+      static void logSummary(QtMsgType type, const QByteArray& category, const char* file, int line, const char* function,
+                             const QString& msg, const QList<QCustomLogField>* fields); /**< Logs a summary message bypassing rate limiting and coalescing */
+      static QString formatTimeNs(qint64 timeNs, bool utcMode); /**< Formats the time as ISO 8601 with milliseconds and the UTC offset according to the UTC mode */
+      static bool loadConfigFile(); /**< Parses the watched config file and applies its settings */
+      static void configFileChanged(); /**< Restores the watch after the file replacement and reloads the file if it was modified */
+      static bool parseLevel(const QString& name, QtMsgType& level); /**< Parses a level name of the config file */
+      static void setCleanRoute(const QString& category, int fd, bool toFile, QFile* file); /**< Replaces the clean route of the category, -2 removes it, takes the file ownership */
+      static void setConsoleCleanCategory(Config& config, const QString& category, bool writeToFile); /**< Replaces the clean log categories routed to the standard output */
+      static bool cleanRoute(const Config& config, CategoryInfo* category, int& fd, bool& toFile); /**< Returns the cached clean route of the category for the snapshot */
+      static void cleanWrite(int fd, const QByteArray& line); /**< Writes a clean UTF-8 line with its line break to the file descriptor */
+      static ReaderCounters* acquireReaderCounters(); /**< Acquires readers counters for the current thread */
+      static void retireConfig(const Config* previous); /**< Switches the readers epoch, retires the replaced snapshot and deletes the retired ones after their grace period, must be called with locked config mutex */
+      static void reclaimConfigs(); /**< Deletes the retired snapshots whose grace period is over, must be called with locked config mutex */
+      static void consoleWrite(ConsoleStream consoleStream, QtMsgType type, const QByteArray& line, bool colored); /**< Writes a UTF-8 line to the console stream, batching concurrent writes, returns once the line is written unless asynchronous */
+      static void startConsoleThread(); /**< Starts the asynchronous console thread */
+      static void stopConsoleThread(); /**< Stops the asynchronous console thread after writing all pending lines */
+      static void consoleRun(); /**< Asynchronous console thread loop */
+      static void enqueueDeferred(DeferredMessage&& message); /**< Passes a raw message to the formatting thread, waits if the queue is full */
+      static void drainDeferred(); /**< Waits until the formatting thread writes all messages queued before */
+      static void startDeferredThread(); /**< Starts the formatting thread */
+      static void stopDeferredThread(); /**< Stops the formatting thread after writing all queued messages */
+      static void deferredRun(); /**< Formatting thread loop */
+      static const char* contextString(const QByteArray& copy) { return copy.isNull() ? nullptr : copy.constData(); } /**< Returns a copied message context string, nullptr if the context had none */
+      static quint64 enqueueMessage(const QByteArray& line); /**< Enqueues a formatted UTF-8 line to the buffer and the crash ring, returns its durability ticket */
+      static void waitForDurability(quint64 ticket); /**< Blocks until the buffer is written up to the ticket, flushing it if no other flush is in progress */
+      static void completeDurability(quint64 ticket); /**< Marks the buffer as written up to the ticket and wakes waiting callers */
       static void callErrorHandler(const QString& msg); /**< Calls error handler with message if it is set */
       static bool ensureDirectoryWritable(const QString& dirPath); /**< Ensures that the directory is writable */
       static void normalizePath(QString& path); /**< Normalizes the path */
 
+      static bool syncLogFile(QFile& logFile); /**< Syncs the opened log file data to the stable storage */
+      static bool openCrashRing(); /**< Recovers the previous crash ring contents and maps a new crash ring */
+      static void recoverCrashRing(); /**< Writes unflushed messages of the existing crash ring file to the log file */
+      static void crashRingWrite(const char* data, quint64 size); /**< Copies data to the crash ring, must be called with locked buffer mutex */
+      static void crashSignalHandler(int signal); /**< Async-signal-safe handler of crash signals */
       static bool rotateLogFiles(QString& logFileName); /**< Rotates log files within the limits based on the current log file name */
+      static bool rotateDatedLogFiles(QString& logFileName); /**< Time-based part of the rotation, switches to a new period or segment */
+      static void publishCrashLogPath(const QString& fileName); /**< Points the crash handler to the new log file, must be called with locked file mutex */
+      static void retentionRebuild(const QFileInfoList& files); /**< Replaces the size ledger with the files ordered from the oldest to the current one */
+      static void retentionAdded(const QString& fileName); /**< Appends a new current log file to the size ledger */
+      static void retentionRemoved(const QString& fileName); /**< Removes a deleted log file from the size ledger */
+      static void startJanitorThread(); /**< Builds the size ledger and starts the retention thread */
+      static void stopJanitorThread(); /**< Stops the retention thread */
+      static void janitorRun(); /**< Retention thread loop */
       static bool logFileTouch(const QString& path); /**< Creates an empty log file with the specified path */
+      static bool logFileFull(const QString& fileName); /**< Checks if the current log file reached the maximum size or does not exist */
+      static void preallocateLogFile(int fd, qint64 offset); /**< Reserves the space of the log file from the offset up to the maximum size */
+      static void releasePreallocation(const QString& fileName); /**< Releases the unused reserved space of the log file being left */
+      static void closeLogFile(); /**< Releases the unused reserved space of the current log file on shutdown */
+      static void retentionWritten(qint64 written); /**< Adds the bytes written to the current log file to the size ledger */
+      static bool syncDue(bool force, qint64 written); /**< Decides if the flush syncs the log file according to the durability mode */
+      static void updateFlushStatistics(qsizetype bufferMessages, float elapsed, bool sync, float syncElapsed); /**< Updates flush and sync time averages */
+      static void updateSyncStatistics(float syncElapsed); /**< Updates the sync time average */
+      #ifdef QCUSTOMLOG_IO_URING
+         static void uringInit(); /**< Creates the ring, the usual writer stays in use on failure */
+         static bool uringOpen(); /**< Opens the current log file for the ring if it changed, waits for the writes to the previous one */
+         static void uringFlush(bool force, quint64 ticket, quint64 ringHead, qsizetype bufferMessages); /**< Submits the spare arena, unlocks the file mutex */
+         static void uringReap(bool drain); /**< Handles completions, waits for a free slot or for all writes and syncs if draining */
+         static void uringExit(); /**< Waits for the writes and syncs in flight, closes the descriptor and destroys the ring, must be called with locked file mutex */
+      #endif
       static inline bool levelGreaterOrEqual(QtMsgType level, QtMsgType minLevel); /**< Checks if the level is greater or equal to the minimum level */
 
       static inline QCustomLog* m_customInstance=nullptr; /**< Custom inheritor storage */
+      static inline thread_local const QList<QCustomLogField>* m_threadFields=nullptr; /**< Fields of the structured message being logged by the current thread */
+      static inline QCustomLogFileSink m_fileSink; /**< Built-in file sink, bit 0 of the routes */
+      static inline QList<QCustomLogSink*> m_sinks; /**< Asynchronous sinks, bits 1-63 of the routes in the list order */
+      static inline QReadWriteLock m_sinksLock; /**< Lock for the sinks list and the sink filters */
+      static inline std::atomic<quint64> m_routesGeneration=1; /**< Incremented on every sinks list or filter change */
+      static inline std::atomic<bool> m_samplingEnabled=false; /**< Any sampling rate or adaptive sampling is set, switched with the snapshot */
+      static inline QMutex m_samplingMutex; /**< Mutex for the adaptive sampling state */
+      static inline std::atomic<quint64> m_samplingGeneration=1; /**< Incremented on every sampling change */
+      static inline std::atomic<quint64> m_rulesGeneration=0; /**< Incremented on every category rules change */
+      static inline std::atomic<QLoggingCategory::CategoryFilter> m_previousCategoryFilter=nullptr; /**< Filter installed before the category rules filter, read by the filter on any thread */
+      static inline bool m_configFileRules=false; /**< Category rules are set by the config file */
+      static inline double m_samplingFactor=1.0; /**< Adaptive sampling factor applied to all rates */
+      static inline quint32 m_adaptiveMaxMessages=0; /**< Adaptive sampling buffer fill threshold, written under the config and sampling mutexes */
+      static inline float m_adaptiveMaxFlushTime=0.0f; /**< Adaptive sampling average flush time threshold in seconds, written under the config and sampling mutexes */
+
+      static constexpr qint64 m_rateSummaryInterval=5000000000; /**< Minimum interval between suppressed messages summaries in nanoseconds */
+      static inline std::atomic<bool> m_rateLimitEnabled=false; /**< Any rate limit is set, switched with the snapshot */
+      static inline thread_local FormatScratch m_formatScratch; /**< Formatting buffers of the current thread */
+      static inline thread_local bool m_summaryBypass=false; /**< Current thread logs a summary that must not be rate limited or coalesced */
+      static inline std::atomic<quint64> m_rateGeneration=1; /**< Incremented on every rate limit change, the category buckets are reset on their next message */
+      static inline std::atomic<qint64> m_rateSummaryCheck=0; /**< Time of the next check for summaries of ended floods in nanoseconds of the monotonic clock */
+      static inline QTimer m_summaryTimer=QTimer(nullptr); /**< Summaries of ended floods timer, independent of buffering */
+
+      static constexpr qsizetype m_coalesceMaxEntries=1024; /**< Maximum number of tracked messages of a category in the windowed mode */
+      static inline std::atomic<bool> m_coalesceEnabled=false; /**< Coalescing is enabled */
+      static inline QMutex m_coalesceSettingsMutex; /**< Serializes coalescing settings changes */
+      static inline std::atomic<qint64> m_coalesceWindow=0; /**< Coalescing window in nanoseconds */
+      static inline std::atomic<bool> m_coalesceConsecutive=false; /**< Only consecutive repeats within a category are coalesced */
+
+      static inline QHash<QByteArray,CategoryInfo*> m_categories; /**< Interned categories, never freed */
+      static inline QReadWriteLock m_categoriesLock; /**< Lock for interned categories */
       static inline ErrorHandler m_errorHandler=nullptr; /**< Error handler storage */
-      static inline QString m_cleanLogCategory; /**< Clean log category storage */
+      static inline const Config m_defaultConfig; /**< Initial snapshot, never deleted */
+      static inline std::atomic<const Config*> m_config=&m_defaultConfig; /**< Current snapshot */
+      static inline QMutex m_configMutex; /**< Mutex for snapshot updates */
+      static inline QFileSystemWatcher* m_configWatcher=nullptr; /**< Config file and its directory watcher, lives on the event loop thread */
+      static inline QString m_configFilePath; /**< Watched config file path */
+      static inline QPair<qint64,qint64> m_configFileStamp={-1,-1}; /**< Modification time and size of the loaded config file */
+      static inline QStringList m_configFileSampling; /**< Sampling categories set by the config file, protected by the config mutex */
+      static inline QStringList m_configFileRateLimits; /**< Rate limit categories set by the config file, protected by the config mutex */
+      static inline std::atomic<quint32> m_configEpoch=0; /**< Readers epoch, its lowest bit selects the readers counter */
+      static inline QMutex m_configReadersMutex; /**< Mutex for the readers counters list */
+      static inline QList<ReaderCounters*> m_configReaders; /**< Readers counters of all threads, never freed, reused after their threads exit, protected by the readers mutex */
+      static inline ReaderCounters m_sharedReaders; /**< Readers counters of threads whose own counters are already released, e.g. messages of thread-local destructors */
+      static inline thread_local ReaderCounters* m_threadReaders=nullptr; /**< Readers counters of the current thread, nullptr until its first reader */
+      static inline thread_local ReaderCountersRelease m_threadReadersRelease; /**< Releases the counters of the current thread on its exit */
+      struct RetiredConfig /**< Replaced snapshot that may still have readers */
+      {
+         const Config* config; /**< Snapshot */
+         bool drained[2]; /**< Readers counter of the even or odd epochs was seen at zero after the retirement */
+      };
+      static inline QList<RetiredConfig> m_retiredConfigs; /**< Snapshots deleted by a later update or the summaries timer once the readers counters of both epochs were seen at zero, protected by the config mutex */
       static inline std::atomic<bool> m_cleanLogCategoryIsSet=false; /**< Clean log category set flag */
-      static inline bool m_cleanToFile=true; /**< Clean log category to file flag */
-      static inline QtMsgType m_minOutLevel=QtMsgType::QtDebugMsg; /**< Minimum output level storage */
-      static inline QtMsgType m_minOutFileLevel=QtMsgType::QtDebugMsg; /**< Minimum output file level storage */
-      static inline QString m_logMessageFormat="'['yyyy.MM.dd HH:mm:ss.zzz']'"; /**< Log message timestamp format */
+      static inline QMutex m_cleanWriteMutex; /**< Keeps clean lines of concurrent messages whole */
+
+      static inline bool m_consoleColors[2]={false,false}; /**< Standard output and error are terminals */
+      static inline QMutex m_consoleMutex; /**< Mutex for console buffers */
+      static inline QByteArray m_consolePending[2]; /**< Console lines waiting for the writer, protected by the console mutex */
+      static inline QByteArray m_consoleBatch[2]; /**< Console lines being written, owned by the writer */
+      static inline bool m_consoleWriting=false; /**< Some thread is writing console lines, protected by the console mutex */
+      static inline quint64 m_consoleEnqueued=0; /**< Number of lines appended in the synchronous mode, protected by the console mutex */
+      static inline quint64 m_consoleWritten=0; /**< Number of lines written in the synchronous mode, protected by the console mutex */
+      static inline QWaitCondition m_consoleWrittenCondition; /**< Wakes logging threads waiting for their lines in the synchronous mode */
+      static inline bool m_consoleAsync=false; /**< Asynchronous console output flag */
+      static inline qint64 m_consoleMaxBytes=(1024*1024); /**< Maximum size of pending console lines in the asynchronous mode */
+      static inline ConsoleOverflow m_consoleOverflow=ConsoleOverflow::DropNewest; /**< Asynchronous console overflow policy */
+      static inline QThread* m_consoleThread=nullptr; /**< Asynchronous console thread, protected by the console mutex */
+      static inline bool m_consoleStopping=false; /**< Console thread stop is requested, protected by the console mutex */
+      static inline qint64 m_consolePendingBytes=0; /**< Size of pending console lines in the asynchronous mode, protected by the console mutex */
+      static inline QWaitCondition m_consoleCondition; /**< Wakes the console thread on new lines or stop */
+      static inline QWaitCondition m_consoleSpaceCondition; /**< Wakes blocked logging threads when the console thread takes pending lines */
+      static inline std::atomic<quint64> m_consoleDropped=0; /**< Dropped console lines count */
+
+      static inline bool m_deferredFormatting=false; /**< Deferred formatting flag */
+      static inline qsizetype m_deferredQueueSize=65536; /**< Maximum number of raw messages waiting for the formatting thread */
+      static inline DeferredOverflow m_deferredOverflow=DeferredOverflow::Block; /**< Deferred formatting queue overflow policy */
+      static constexpr qsizetype m_deferredBatchSize=256; /**< Maximum number of raw messages the formatting thread takes at once */
+      static inline QMutex m_deferredMutex; /**< Mutex for the raw messages queue and the formatting thread state */
+      static inline QWaitCondition m_deferredCondition; /**< Wakes the formatting thread on new messages or stop */
+      static inline QWaitCondition m_deferredSpaceCondition; /**< Wakes logging threads waiting for the queue space */
+      static inline QWaitCondition m_deferredWrittenCondition; /**< Wakes logging threads waiting for the queued messages to be written */
+      static inline QVector<DeferredMessage> m_deferredSlots; /**< Preallocated ring of raw message slots, protected by the deferred mutex */
+      static inline qsizetype m_deferredHead=0; /**< Oldest queued raw message, protected by the deferred mutex */
+      static inline qsizetype m_deferredCount=0; /**< Number of queued raw messages, protected by the deferred mutex */
+      static inline std::atomic<quint64> m_deferredDropped=0; /**< Dropped raw messages count */
+      static inline QSet<QByteArray> m_contextStrings; /**< Interned source files and functions of deferred messages, never freed */
+      static inline QReadWriteLock m_contextStringsLock; /**< Lock for interned message context strings */
+      static inline QThread* m_deferredThread=nullptr; /**< Formatting thread, protected by the deferred mutex */
+      static inline bool m_deferredStopping=false; /**< Formatting thread stop is requested, protected by the deferred mutex */
+      static inline quint64 m_deferredEnqueued=0; /**< Number of queued raw messages, protected by the deferred mutex */
+      static inline quint64 m_deferredWritten=0; /**< Number of written raw messages, protected by the deferred mutex */
+      static inline thread_local bool m_deferredThreadOwner=false; /**< Current thread is the formatting thread */
 
       static inline QMutex m_logBufferMutex; /**< Mutex for log buffer */
       static inline QMutex m_logFileMutex; /**< Mutex for log file operations */
       static inline QMutex m_customHandlerMutex; /**< Mutex for custom log handler operations */
+      static inline thread_local bool m_customHandlerActive=false; /**< Current thread is inside the custom instance, its nested messages are not passed to it */
       static inline QMutex M_errorHandlerMutex; /**< Mutex for error handler operations */
 
       static inline QDir m_logDir=QDir(); /**< Log files directory */
@@ -251,22 +1283,114 @@ class QCustomLog
 
       static inline quint32 m_maxLogFiles=10; /**< Maximum number of log files */
       static inline quint32 m_maxLogFileSize=(10*1024*1024); /**< Maximum size of a log file */
+      static inline RotationPeriod m_rotationPeriod=RotationPeriod::None; /**< Time-based rotation period */
+      static inline bool m_preallocate=false; /**< Log files preallocation flag */
+      static inline qint64 m_logFileEnd=-1; /**< Logical end of the current log file, saves a file status call per flush, -1 if unknown, protected by the file mutex */
+      static inline quint64 m_logFileGeneration=0; /**< Incremented on every created log file, protected by the file mutex */
+      static inline bool m_uringEnabled=false; /**< io_uring log file writer flag */
+      static inline quint32 m_uringDepth=4; /**< Maximum number of flushes in flight */
+      #ifdef QCUSTOMLOG_IO_URING
+         struct UringWrite /**< Flush submitted to the ring */
+         {
+            QByteArray data; /**< Written arena, kept until the completion and then reused */
+            qint64 offset=0; /**< Log file offset */
+            quint64 ticket=0; /**< Buffer ticket completed with the write */
+            quint64 ringHead=0; /**< Crash ring position written with the write */
+            bool done=false; /**< Write is completed, waits for the earlier ones */
+            UringWrite() {}
+         };
+         static inline io_uring* m_uring=nullptr; /**< Ring of the log file writer, nullptr if not used, protected by the file mutex */
+         static inline QVector<UringWrite> m_uringWrites; /**< Slots of flushes in flight, never reallocated while the ring is used */
+         static inline int m_uringHead=0; /**< Oldest flush in flight */
+         static inline int m_uringCount=0; /**< Number of occupied slots */
+         static inline int m_uringSyncs=0; /**< Number of syncs in flight */
+         static inline QQueue<qint64> m_uringSyncStarts; /**< Submission times of the syncs in flight in nanoseconds of the monotonic clock */
+         static inline std::atomic<int> m_uringFd=-1; /**< Log file descriptor of the ring, also read by the crash handler */
+         static inline QString m_uringFileName; /**< Log file name of the descriptor */
+         static inline quint64 m_uringGeneration=0; /**< Log file generation of the descriptor */
+         static inline std::atomic<qint64> m_uringOffset=0; /**< Offset of the next write, writes in flight may complete in any order, also read by the crash handler */
+      #endif
+      static inline qint64 m_rotationDeadline=0; /**< End of the current rotation period in nanoseconds since the epoch, protected by the file mutex */
+      static inline QString m_rotationStamp; /**< Start of the current rotation period in log file names, protected by the file mutex */
+      static inline int m_rotationSegment=0; /**< Segment number of the current log file in its period, protected by the file mutex */
+
+      struct RetainedFile /**< Size ledger entry */
+      {
+         QString name; /**< Log file name */
+         qint64 size; /**< Log file size */
+         qint64 modifiedNs; /**< Last write time in nanoseconds since the epoch, updated when the file stops being current */
+      };
+      static inline quint64 m_retentionMaxSize=0; /**< Maximum total size of log files, 0 means no limit */
+      static inline qint64 m_retentionMaxAge=0; /**< Maximum age of log files in milliseconds, 0 means no limit */
+      static inline QList<RetainedFile> m_retentionLedger; /**< Log files from the oldest to the current one, protected by the file mutex */
+      static inline quint64 m_retentionTotal=0; /**< Total size of the ledger files, protected by the file mutex */
+      static inline QThread* m_janitorThread=nullptr; /**< Retention thread, protected by the file mutex */
+      static inline bool m_janitorStopping=false; /**< Retention thread stop is requested, protected by the file mutex */
+      static inline QWaitCondition m_janitorCondition; /**< Wakes the retention thread on rotation, over budget or stop */
 
       static inline QTimer m_logBufferTimer=QTimer(nullptr); /**< Buffer flush timer */
-      static inline QQueue<QString> m_logBuffer; /**< Log message buffer */
-      static inline quint32 m_maxBufferMessages=0; /**< Maximum detected messages in the buffer */
+      static inline QByteArray m_logBuffer; /**< Log buffer arena of UTF-8 lines with line breaks */
+      static inline qsizetype m_logBufferMessages=0; /**< Number of messages in the buffer, protected by the buffer mutex */
+      static inline QByteArray m_logBufferSpare; /**< Arena being written to the file, swapped with the buffer, protected by the file mutex */
+      static inline std::atomic<quint64> m_bufferGrowths=0; /**< Growths of the buffer arena and the formatting buffers */
+      static inline FileFormat m_fileFormat=FileFormat::Text; /**< Log file format */
+      static inline bool m_jsonEpochTime=false; /**< JSON time in nanoseconds since the epoch flag */
       static inline bool m_logBufferEnabled=false; /**< Buffering state, thread-safe for reading */
+      static inline quint64 m_logBufferTicket=0; /**< Ticket of the last message enqueued to the buffer, protected by the buffer mutex */
+
+      static inline QMutex m_durabilityMutex; /**< Mutex for group commit state */
+      static inline QWaitCondition m_durabilityCondition; /**< Wakes callers waiting for their messages to be written */
+      static inline quint64 m_durableTicket=0; /**< Ticket of the last message written to the file, protected by the durability mutex */
+      static inline bool m_durabilityFlushActive=false; /**< Group commit flush is in progress, protected by the durability mutex */
+
+      static inline Durability m_durability=Durability::FlushToOs; /**< Log file durability mode */
+      static inline quint32 m_syncInterval=1000; /**< Periodic sync interval in milliseconds */
+      static inline quint32 m_syncSize=(1024*1024); /**< Periodic sync size in bytes */
+      static inline qint64 m_unsyncedBytes=0; /**< Bytes written since the last sync, protected by the file mutex */
+      static inline QElapsedTimer m_lastSyncTimer; /**< Time since the last sync, protected by the file mutex */
+
+      struct CrashRingHeader /**< Crash ring file header, the ring data follows it */
+      {
+         quint64 magic; /**< Crash ring file signature */
+         quint64 capacity; /**< Size of the ring data in bytes */
+         quint64 head; /**< Total bytes ever written to the ring, protected by the buffer mutex */
+         quint64 flushed; /**< Total bytes already written to the log file */
+      };
+      static constexpr quint64 m_crashRingMagic=0x31474E49524C4351; /**< Crash ring file signature, "QCLRING1" */
+      static inline quint32 m_crashRingSize=0; /**< Crash ring data size, 0 means disabled */
+      static inline QFile m_crashRingFile; /**< Crash ring file, kept open while mapped */
+      static inline uchar* m_crashRing=nullptr; /**< Crash ring mapping starting with the header */
+      static inline QByteArray m_crashLogPath[2]; /**< Preallocated native paths of the log file for the crash handler, the inactive one is replaced on rotation */
+      static inline std::atomic<int> m_crashLogPathIndex=0; /**< Index of the active crash handler log file path */
+      struct CrashStack /**< Alternate signal stack of a thread for the crash handler */
+      {
+         char* data=nullptr; /**< Preallocated stack memory */
+         CrashStack() {}
+         ~CrashStack(); /**< Disables the alternate stack before releasing it */
+      };
+      static inline thread_local CrashStack m_crashStack; /**< Alternate signal stack of the current thread */
+      static inline std::atomic<bool> m_crashHandling=false; /**< Crash handler is already running in some thread */
 
       static inline std::atomic<float> m_logBufferFlushTime=0.0f; /**< Average buffer flush time in seconds */
+      static inline std::atomic<float> m_logSyncTime=0.0f; /**< Average log file sync time in seconds */
+      static inline std::atomic<quint64> m_logFileSyncs=0; /**< Log file syncs count */
       static inline std::atomic<float> m_logRotationTime=0.0f; /**< Average log rotation time in seconds */
 
    protected:
       explicit QCustomLog() {} /**< Prohibit direct instantiation */
-      virtual ~QCustomLog() { QCustomLog::flushBuffer(false); } /**< Polymorphic destructor */
+      virtual ~QCustomLog() {} /**< Polymorphic destructor, the process-wide logging state is shut down with the QCoreApplication, not with an instance */
 
       virtual void sendLog(const QDateTime& time, const QtMsgType type, const QString& category, const QString& msg) {} /**< Custom log message handler for inheritor */
 
-      static inline bool m_utcMode=false; /**< UTC time flag */
+      /**
+       * @brief Custom log record handler for inheritor
+       * @details Receives the raw time and the already built texts, so inheritors that do not need a QDateTime do not pay for one,
+       *          the default implementation converts the time and calls @see sendLog()
+       * @param record Record view, valid only during the call
+       */
+      virtual void sendRecord(const QCustomLogRecordView& record);
+
+      static inline std::atomic<bool> m_utcMode=false; /**< UTC time flag, a copy of the current snapshot value for inheritors, written on settings changes while other threads log */
 };
 
 #endif // QCUSTOMLOG_H
@@ -0,0 +1,108 @@
+/**
+ * @file tst_asyncconsole.cpp
+ * @brief Asynchronous console output tests
+ * @details Checks that a stalled standard error, a pipe nobody reads, does not block logging with ConsoleOverflow::DropNewest,
+ *          that the lines over the limit are dropped and counted while the log file gets every message,
+ *          and that the number of dropped lines is written once the stream recovers
+ *
+ * @details This code is released under the MIT license
+ * @copyright (c) 2025 Dmitrii Permiakov [nebster9k]
+ *
+ * @see qcustomlog.h
+ */
+
+#include <qcustomlog.h>
+
+#include <QTest>
+#include <QTemporaryDir>
+
+#ifndef Q_OS_WIN
+   #include <unistd.h>
+#endif
+
+Q_LOGGING_CATEGORY(lcConsole,"CONSOLE")
+
+class TestAsyncConsole : public QObject
+{
+   Q_OBJECT
+
+   private slots:
+      void initTestCase();
+      void stalledStreamDropsNewest();
+      void cleanupTestCase();
+
+   private:
+      QTemporaryDir m_dir; /**< Log files directory */
+      int m_pipe[2]={-1,-1}; /**< Pipe replacing the standard error */
+      int m_stderr=-1; /**< Original standard error */
+};
+
+void TestAsyncConsole::initTestCase()
+{
+   #ifdef Q_OS_WIN
+      QSKIP("The standard error is replaced by a POSIX pipe");
+   #else
+      QVERIFY(m_dir.isValid());
+
+      // before initLogging(), so the console is not a terminal and has no colors
+      QVERIFY(pipe(m_pipe)==0);
+      m_stderr=dup(STDERR_FILENO);
+      QVERIFY(m_stderr>=0 && dup2(m_pipe[1],STDERR_FILENO)>=0);
+
+      QCustomLog::setAsyncConsole(true,4096,QCustomLog::ConsoleOverflow::DropNewest);
+      QVERIFY(QCustomLog::initLogging(m_dir.path(),0)); // buffering is disabled, so every message is in the file when the logging call returns
+   #endif
+}
+
+void TestAsyncConsole::stalledStreamDropsNewest()
+{
+   #ifndef Q_OS_WIN
+      // far more than the pipe capacity and the pending limit, the console thread stalls in its write and the logging thread keeps going
+      const int total=2000;
+      const QString payload(200,QChar('x'));
+      for(int i=0;i<total;i++) qCWarning(lcConsole).noquote() << "console flood" << payload;
+      quint64 dropped=QCustomLog::consoleDroppedMessages();
+      QVERIFY(dropped>0 && dropped<(quint64)total);
+
+      // every line is either written or dropped, the note goes before the first batch written after the drops
+      QByteArray note="*** "+QByteArray::number(dropped)+" console messages dropped ***\n", output;
+      int readEnd=m_pipe[0];
+      QThread* reader=QThread::create([readEnd,&output,&note,expected=total-(int)dropped]()
+      {
+         char chunk[4096];
+         while(!output.contains(note) || output.count("console flood")<expected)
+         {
+            ssize_t size=read(readEnd,chunk,sizeof(chunk));
+            if(size<=0) break;
+            output.append(chunk,size);
+         }
+      });
+      reader->start();
+      bool finished=reader->wait(10000);
+
+      // the original stream is restored and the pipe is closed, so a reader that waits for more data returns
+      dup2(m_stderr,STDERR_FILENO); close(m_pipe[1]); m_pipe[1]=-1;
+      reader->wait(); delete reader;
+      QVERIFY(finished);
+
+      QVERIFY(output.contains(note));
+      QCOMPARE((quint64)output.count("console flood"),total-dropped);
+      QCOMPARE(QCustomLog::consoleDroppedMessages(),dropped);
+
+      QFile logFile(m_dir.filePath(QCoreApplication::applicationName()+"_0.log"));
+      QVERIFY(logFile.open(QFile::OpenModeFlag::ReadOnly));
+      QCOMPARE(logFile.readAll().count("console flood"),total);
+   #endif
+}
+
+void TestAsyncConsole::cleanupTestCase()
+{
+   #ifndef Q_OS_WIN
+      if(m_stderr>=0) { dup2(m_stderr,STDERR_FILENO); close(m_stderr); }
+      if(m_pipe[1]>=0) close(m_pipe[1]);
+      // the read end stays open, so a late write of the console thread to the pipe does not raise SIGPIPE
+   #endif
+}
+
+QTEST_GUILESS_MAIN(TestAsyncConsole)
+#include "tst_asyncconsole.moc"
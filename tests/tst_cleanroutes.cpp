@@ -0,0 +1,115 @@
+/**
+ * @file tst_cleanroutes.cpp
+ * @brief Clean log category routes tests
+ * @details Checks that messages of clean log categories are written without formatting to their output file or file descriptor,
+ *          that the writeToFile flag keeps them out of the log file or copies them there, and that routes are replaced and removed at runtime
+ *
+ * @details This code is released under the MIT license
+ * @copyright (c) 2025 Dmitrii Permiakov [nebster9k]
+ *
+ * @see qcustomlog.h
+ */
+
+#include <qcustomlog.h>
+
+#include <QTest>
+#include <QTemporaryDir>
+
+Q_LOGGING_CATEGORY(lcCi,"CI/CD")
+Q_LOGGING_CATEGORY(lcMetrics,"METRICS")
+
+class TestCleanRoutes : public QObject
+{
+   Q_OBJECT
+
+   private slots:
+      void initTestCase();
+      void routeToFile();
+      void routeToDescriptor();
+      void routesAreReplacedAndRemoved();
+      void invalidRoutesAreRejected();
+
+   private:
+      QByteArray fileContents(const QString& fileName) const; /**< Returns the contents of a file of the directory */
+      QByteArray logContents() const { return fileContents(QCoreApplication::applicationName()+"_0.log"); } /**< Returns the current log file contents */
+
+      QTemporaryDir m_dir; /**< Log files and clean outputs directory */
+};
+
+void TestCleanRoutes::initTestCase()
+{
+   QVERIFY(m_dir.isValid());
+   QCustomLog::setMinLevels(QtMsgType::QtFatalMsg,QtMsgType::QtDebugMsg); // only the file outputs are checked
+   QVERIFY(QCustomLog::initLogging(m_dir.path(),0)); // buffering is disabled, so every message is in the file when the logging call returns
+}
+
+QByteArray TestCleanRoutes::fileContents(const QString& fileName) const
+{
+   QFile file(m_dir.filePath(fileName));
+   if(!file.open(QFile::OpenModeFlag::ReadOnly)) return QByteArray();
+   return file.readAll();
+}
+
+void TestCleanRoutes::routeToFile()
+{
+   QVERIFY(!QCustomLog::haveCleanCategory());
+   QVERIFY(QCustomLog::addCleanCategory("CI/CD",m_dir.filePath("ci.txt"),false));
+   QVERIFY(QCustomLog::haveCleanCategory());
+
+   qCInfo(lcCi).noquote() << "step 1 passed";
+   qCWarning(lcCi).noquote() << QString::fromUtf8("step 2 \xC3\xA9" "chou\xC3\xA9");
+   qCInfo(lcMetrics).noquote() << "ordinary message";
+
+   // unformatted UTF-8 lines, kept out of the log file
+   QCOMPARE(fileContents("ci.txt"),QByteArray("step 1 passed\nstep 2 \xC3\xA9" "chou\xC3\xA9\n"));
+   QByteArray contents=logContents();
+   QVERIFY(!contents.contains("step 1 passed"));
+   QVERIFY(contents.contains("[INF] [METRICS] ordinary message"));
+}
+
+void TestCleanRoutes::routeToDescriptor()
+{
+   QFile metrics(m_dir.filePath("metrics.txt"));
+   QVERIFY(metrics.open(QFile::OpenModeFlag::WriteOnly|QFile::OpenModeFlag::Append));
+   QVERIFY(QCustomLog::addCleanCategory("METRICS",metrics.handle(),true));
+
+   qCInfo(lcMetrics).noquote() << "requests=42";
+
+   // the descriptor gets the clean line, the log file a formatted copy
+   QCOMPARE(fileContents("metrics.txt"),QByteArray("requests=42\n"));
+   QVERIFY(logContents().contains("[INF] [METRICS] requests=42"));
+
+   // the descriptor is not closed by the library
+   QCustomLog::removeCleanCategory("METRICS");
+   QCOMPARE(metrics.write("written by the owner\n"),(qint64)21);
+   QVERIFY(metrics.flush());
+   QCOMPARE(fileContents("metrics.txt"),QByteArray("requests=42\nwritten by the owner\n"));
+}
+
+void TestCleanRoutes::routesAreReplacedAndRemoved()
+{
+   // replacing the route switches the output file of the category
+   QVERIFY(QCustomLog::addCleanCategory("CI/CD",m_dir.filePath("ci2.txt"),true));
+   qCInfo(lcCi).noquote() << "step 3 passed";
+   QVERIFY(!fileContents("ci.txt").contains("step 3 passed"));
+   QCOMPARE(fileContents("ci2.txt"),QByteArray("step 3 passed\n"));
+   QVERIFY(logContents().contains("[INF] [CI/CD] step 3 passed"));
+
+   // removed categories are logged as usual again
+   QCustomLog::removeCleanCategory("CI/CD");
+   QVERIFY(!QCustomLog::haveCleanCategory());
+   qCInfo(lcCi).noquote() << "step 4 passed";
+   QVERIFY(!fileContents("ci2.txt").contains("step 4 passed"));
+   QVERIFY(logContents().contains("[INF] [CI/CD] step 4 passed"));
+}
+
+void TestCleanRoutes::invalidRoutesAreRejected()
+{
+   QVERIFY(!QCustomLog::addCleanCategory("CI/CD",-1));
+   QVERIFY(!QCustomLog::addCleanCategory(QString(),m_dir.filePath("ci.txt")));
+   QVERIFY(!QCustomLog::addCleanCategory("CI/CD",m_dir.filePath("missing/ci.txt")));
+   QVERIFY(!QCustomLog::haveCleanCategory());
+}
+
+QTEST_GUILESS_MAIN(TestCleanRoutes)
+#include "tst_cleanroutes.moc"
@@ -0,0 +1,112 @@
+/**
+ * @file tst_coalescing.cpp
+ * @brief Duplicate messages coalescing tests
+ * @details Checks that repeats are collapsed into one summary with the repeated, first and last fields,
+ *          when another message breaks a consecutive run, when the window ends and when the settings change
+ *
+ * @details This code is released under the MIT license
+ * @copyright (c) 2025 Dmitrii Permiakov [nebster9k]
+ *
+ * @see qcustomlog.h
+ */
+
+#include <algorithm>
+
+#include <qcustomlog.h>
+
+#include <QTest>
+#include <QTemporaryDir>
+
+Q_LOGGING_CATEGORY(lcConsecutive,"CONSECUTIVE")
+Q_LOGGING_CATEGORY(lcWindowed,"WINDOWED")
+Q_LOGGING_CATEGORY(lcExpiring,"EXPIRING")
+
+class TestCoalescing : public QObject
+{
+   Q_OBJECT
+
+   private slots:
+      void initTestCase();
+      void consecutiveRunIsBrokenByAnotherMessage();
+      void windowedRepeatsAreSummarizedOnSettingsChange();
+      void endedWindowStartsNewRun();
+
+   private:
+      QList<QByteArray> categoryMessages(const QByteArray& category) const; /**< Returns the logged messages of the category in the file order */
+
+      QTemporaryDir m_dir; /**< Log files directory */
+};
+
+void TestCoalescing::initTestCase()
+{
+   QVERIFY(m_dir.isValid());
+   QCustomLog::setMinLevels(QtMsgType::QtFatalMsg,QtMsgType::QtDebugMsg); // only the file output is checked
+   QVERIFY(QCustomLog::initLogging(m_dir.path(),0)); // buffering is disabled, so every message is in the file when the logging call returns
+}
+
+QList<QByteArray> TestCoalescing::categoryMessages(const QByteArray& category) const
+{
+   QFile logFile(m_dir.filePath(QCoreApplication::applicationName()+"_0.log"));
+   if(!logFile.open(QFile::OpenModeFlag::ReadOnly)) return QList<QByteArray>();
+
+   QList<QByteArray> messages; QByteArray tag=" ["+category+"] ";
+   for(const QByteArray& line:logFile.readAll().split('\n'))
+   {
+      qsizetype position=line.indexOf(tag);
+      if(position>=0) messages.append(line.mid(position+tag.size()));
+   }
+   return messages;
+}
+
+void TestCoalescing::consecutiveRunIsBrokenByAnotherMessage()
+{
+   QCustomLog::setCoalescing(60000,true);
+   for(int i=0;i<3;i++) qCInfo(lcConsecutive).noquote() << "message A";
+   qCInfo(lcConsecutive).noquote() << "message B";
+   qCInfo(lcConsecutive).noquote() << "message A";
+
+   // the summary of the run goes right before the message that broke it, a message without repeats has none
+   QList<QByteArray> messages=categoryMessages("CONSECUTIVE");
+   QCOMPARE(messages.count(),4);
+   QCOMPARE(messages.at(0),QByteArray("message A"));
+   QVERIFY(messages.at(1).startsWith("message A repeated=2 first="));
+   QVERIFY(messages.at(1).contains(" last="));
+   QCOMPARE(messages.at(2),QByteArray("message B"));
+   QCOMPARE(messages.at(3),QByteArray("message A"));
+   QCustomLog::setCoalescing(0);
+}
+
+void TestCoalescing::windowedRepeatsAreSummarizedOnSettingsChange()
+{
+   QCustomLog::setCoalescing(60000);
+   for(int i=0;i<3;i++) { qCInfo(lcWindowed).noquote() << "message A"; qCInfo(lcWindowed).noquote() << "message B"; }
+   qCWarning(lcWindowed).noquote() << "message A"; // another level is another message
+   QCOMPARE(categoryMessages("WINDOWED"),QList<QByteArray>({"message A","message B","message A"}));
+
+   // interleaved repeats are counted per message within the window, the runs of the previous settings are summarized on a change
+   QCustomLog::setCoalescing(0);
+   QList<QByteArray> messages=categoryMessages("WINDOWED");
+   QCOMPARE(messages.count(),5);
+   auto summaries=[&messages](const char* prefix) { return (int)std::count_if(messages.cbegin(),messages.cend(),[prefix](const QByteArray& message) { return message.startsWith(prefix); }); };
+   QCOMPARE(summaries("message A repeated=2 first="),1);
+   QCOMPARE(summaries("message B repeated=2 first="),1);
+}
+
+void TestCoalescing::endedWindowStartsNewRun()
+{
+   QCustomLog::setCoalescing(200);
+   qCInfo(lcExpiring).noquote() << "message C";
+   qCInfo(lcExpiring).noquote() << "message C";
+   QTest::qSleep(300);
+   qCInfo(lcExpiring).noquote() << "message C";
+
+   QList<QByteArray> messages=categoryMessages("EXPIRING");
+   QCOMPARE(messages.count(),3);
+   QCOMPARE(messages.at(0),QByteArray("message C"));
+   QVERIFY(messages.at(1).startsWith("message C repeated=1 first="));
+   QCOMPARE(messages.at(2),QByteArray("message C"));
+   QCustomLog::setCoalescing(0);
+}
+
+QTEST_GUILESS_MAIN(TestCoalescing)
+#include "tst_coalescing.moc"
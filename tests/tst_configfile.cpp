@@ -0,0 +1,79 @@
+/**
+ * @file tst_configfile.cpp
+ * @brief Watched config file tests
+ * @details Checks that the settings of the documented INI format are applied
+ *
+ * @details This code is released under the MIT license
+ * @copyright (c) 2025 Dmitrii Permiakov [nebster9k]
+ *
+ * @see qcustomlog.h
+ */
+
+#include <qcustomlog.h>
+
+#include <QTest>
+#include <QTemporaryDir>
+
+class TestConfigFile : public QObject
+{
+   Q_OBJECT
+
+   private slots:
+      void initTestCase();
+      void readmeExampleAppliesLevels();
+      void cleanupTestCase();
+
+   private:
+      bool writeConfig(const QByteArray& contents); /**< Replaces the config file contents */
+      QByteArray logContents() const; /**< Returns the current log file contents */
+
+      QTemporaryDir m_dir; /**< Log files and config file directory */
+};
+
+void TestConfigFile::initTestCase()
+{
+   QVERIFY(m_dir.isValid());
+   QVERIFY(QCustomLog::initLogging(m_dir.path(),0)); // buffering is disabled, so every message is in the file when the logging call returns
+}
+
+bool TestConfigFile::writeConfig(const QByteArray& contents)
+{
+   QFile config(m_dir.filePath("logging.ini"));
+   if(!config.open(QFile::OpenModeFlag::WriteOnly|QFile::OpenModeFlag::Truncate)) return false;
+   return config.write(contents)==contents.size();
+}
+
+QByteArray TestConfigFile::logContents() const
+{
+   QFile logFile(m_dir.filePath(QCoreApplication::applicationName()+"_0.log"));
+   if(!logFile.open(QFile::OpenModeFlag::ReadOnly)) return QByteArray();
+   return logFile.readAll();
+}
+
+void TestConfigFile::readmeExampleAppliesLevels()
+{
+   QCustomLog::setMinLevels(QtMsgType::QtWarningMsg,QtMsgType::QtWarningMsg);
+   qInfo(QLoggingCategory("CONFIG")).noquote() << "info before the config file";
+   QVERIFY(!logContents().contains("info before the config file"));
+
+   // the example of the README, the levels are in the [General] section
+   QVERIFY(writeConfig("[General]\noutputLevel=debug\nfileLevel=debug\n\n[Sampling]\nNET=0.05\n\n[RateLimit]\nNET=100\n"));
+   QVERIFY(QCustomLog::watchConfigFile(m_dir.filePath("logging.ini")));
+   qInfo(QLoggingCategory("CONFIG")).noquote() << "info after the config file";
+   QVERIFY(logContents().contains("info after the config file"));
+
+   // missing keys keep their values, present ones replace them
+   QVERIFY(writeConfig("[General]\nfileLevel=critical\n"));
+   QVERIFY(QCustomLog::watchConfigFile(m_dir.filePath("logging.ini")));
+   qWarning(QLoggingCategory("CONFIG")).noquote() << "warning below the file level";
+   QVERIFY(!logContents().contains("warning below the file level"));
+}
+
+void TestConfigFile::cleanupTestCase()
+{
+   QCustomLog::watchConfigFile(QString());
+   QCustomLog::setMinLevels(QtMsgType::QtDebugMsg,QtMsgType::QtDebugMsg);
+}
+
+QTEST_GUILESS_MAIN(TestConfigFile)
+#include "tst_configfile.moc"
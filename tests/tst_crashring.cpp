@@ -0,0 +1,112 @@
+/**
+ * @file tst_crashring.cpp
+ * @brief Crash ring tests
+ * @details Checks that unflushed messages of a crash ring left by a previous process are recovered into the log file,
+ *          and that the new crash ring tracks the buffered and flushed messages
+ *
+ * @details This code is released under the MIT license
+ * @copyright (c) 2025 Dmitrii Permiakov [nebster9k]
+ *
+ * @see qcustomlog.h
+ */
+
+#include <qcustomlog.h>
+
+#include <QTest>
+#include <QTemporaryDir>
+
+Q_LOGGING_CATEGORY(lcCrashRing,"CRASHRING")
+
+class TestCrashRing : public QObject
+{
+   Q_OBJECT
+
+   private slots:
+      void initTestCase();
+      void unflushedMessagesAreRecovered();
+      void ringFollowsBufferAndFlush();
+
+   private:
+      struct RingHeader /**< Layout of the crash ring file header */
+      {
+         quint64 magic; /**< Crash ring file signature */
+         quint64 capacity; /**< Size of the ring data in bytes */
+         quint64 head; /**< Total bytes ever written to the ring */
+         quint64 flushed; /**< Total bytes already written to the log file */
+      };
+
+      QString ringPath() const { return m_dir.filePath(QCoreApplication::applicationName()+".ring"); } /**< Returns the crash ring file path */
+      QByteArray logContents() const; /**< Returns the current log file contents */
+
+      QTemporaryDir m_dir; /**< Log files directory */
+      QByteArray m_unflushed; /**< Messages of the previous process that were not flushed */
+};
+
+void TestCrashRing::initTestCase()
+{
+   QVERIFY(m_dir.isValid());
+
+   // ring of a crashed process, the stream wraps around the small ring and its head is ahead of the flushed bytes
+   const quint64 capacity=64;
+   QByteArray written="written message\n"; written.prepend(QByteArray(100-written.size(),'#'));
+   m_unflushed="unflushed message one\nunflushed message two\n";
+   QByteArray stream=written+m_unflushed;
+
+   RingHeader header={0x31474E49524C4351,capacity,(quint64)stream.size(),(quint64)written.size()}; // "QCLRING1"
+   QByteArray ring(capacity,'\0');
+   for(quint64 i=header.head-capacity;i<header.head;i++) ring[(int)(i%capacity)]=stream.at((int)i);
+
+   QFile ringFile(ringPath());
+   QVERIFY(ringFile.open(QFile::OpenModeFlag::WriteOnly|QFile::OpenModeFlag::Truncate));
+   QVERIFY(ringFile.write(reinterpret_cast<const char*>(&header),sizeof(header))==sizeof(header));
+   QVERIFY(ringFile.write(ring)==ring.size());
+   ringFile.close();
+
+   QCustomLog::setMinLevels(QtMsgType::QtFatalMsg,QtMsgType::QtDebugMsg); // only the file output is checked
+   QCustomLog::setCrashRingSize(64*1024);
+   QVERIFY(QCustomLog::initLogging(m_dir.path(),10000));
+}
+
+QByteArray TestCrashRing::logContents() const
+{
+   QFile logFile(m_dir.filePath(QCoreApplication::applicationName()+"_0.log"));
+   if(!logFile.open(QFile::OpenModeFlag::ReadOnly)) return QByteArray();
+   return logFile.readAll();
+}
+
+void TestCrashRing::unflushedMessagesAreRecovered()
+{
+   QByteArray contents=logContents();
+   QVERIFY(contents.contains("[WRN] [QCustomLog] Recovered "+QByteArray::number(m_unflushed.size())+" bytes of unflushed log from the crash ring\n"));
+   QVERIFY(contents.contains(m_unflushed));
+   QVERIFY(!contents.contains("written message"));
+   QVERIFY(!contents.contains("overwritten"));
+}
+
+void TestCrashRing::ringFollowsBufferAndFlush()
+{
+   auto readRing=[this](RingHeader& header, QByteArray& data)
+   {
+      QFile ringFile(ringPath());
+      if(!ringFile.open(QFile::OpenModeFlag::ReadOnly) || ringFile.read(reinterpret_cast<char*>(&header),sizeof(header))!=sizeof(header)) return false;
+      data=ringFile.readAll();
+      return true;
+   };
+
+   RingHeader header; QByteArray data;
+   qCInfo(lcCrashRing).noquote() << "buffered message in the ring";
+   QVERIFY(readRing(header,data));
+   QCOMPARE(header.capacity,(quint64)(64*1024));
+   QVERIFY(header.head>header.flushed);
+   QVERIFY(data.contains("buffered message in the ring\n"));
+   QVERIFY(!logContents().contains("buffered message in the ring"));
+
+   // the flush of the critical message marks the ring as written up to its head
+   qCCritical(lcCrashRing).noquote() << "critical message flushing the ring";
+   QVERIFY(readRing(header,data));
+   QCOMPARE(header.flushed,header.head);
+   QVERIFY(logContents().contains("buffered message in the ring"));
+}
+
+QTEST_GUILESS_MAIN(TestCrashRing)
+#include "tst_crashring.moc"
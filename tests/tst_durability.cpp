@@ -0,0 +1,111 @@
+/**
+ * @file tst_durability.cpp
+ * @brief Durability and group commit tests
+ * @details Checks that critical messages are written and synced before the logging call returns,
+ *          and that concurrent critical messages are committed together by one flush and one sync
+ *
+ * @details This code is released under the MIT license
+ * @copyright (c) 2025 Dmitrii Permiakov [nebster9k]
+ *
+ * @see qcustomlog.h
+ */
+
+#include <qcustomlog.h>
+
+#include <QTest>
+#include <QTemporaryDir>
+
+Q_LOGGING_CATEGORY(lcDurability,"DURABILITY")
+
+class TestDurability : public QObject
+{
+   Q_OBJECT
+
+   private slots:
+      void initTestCase();
+      void criticalIsWrittenAndSynced();
+      void noneKeepsCriticalBuffered();
+      void concurrentCriticalsShareSync();
+
+   private:
+      QByteArray logContents() const; /**< Returns the current log file contents */
+
+      QTemporaryDir m_dir; /**< Log files directory */
+};
+
+void TestDurability::initTestCase()
+{
+   QVERIFY(m_dir.isValid());
+   QCustomLog::setMinLevels(QtMsgType::QtFatalMsg,QtMsgType::QtDebugMsg); // only the file output is checked
+   QCustomLog::setDurability(QCustomLog::Durability::SyncOnCritical);
+   QVERIFY(QCustomLog::initLogging(m_dir.path(),10000,10,256*1024*1024)); // buffered, the timer never fires without an event loop
+}
+
+QByteArray TestDurability::logContents() const
+{
+   QFile logFile(m_dir.filePath(QCoreApplication::applicationName()+"_0.log"));
+   if(!logFile.open(QFile::OpenModeFlag::ReadOnly)) return QByteArray();
+   return logFile.readAll();
+}
+
+void TestDurability::criticalIsWrittenAndSynced()
+{
+   quint64 syncs=QCustomLog::logFileSyncs();
+   qCInfo(lcDurability).noquote() << "info waiting in the buffer";
+   QVERIFY(!logContents().contains("info waiting in the buffer"));
+
+   // the flush of the critical message writes everything queued before it
+   qCCritical(lcDurability).noquote() << "critical with its ticket";
+   QByteArray contents=logContents();
+   QVERIFY(contents.contains("info waiting in the buffer"));
+   QVERIFY(contents.contains("critical with its ticket"));
+   QCOMPARE(QCustomLog::logFileSyncs(),syncs+1);
+}
+
+void TestDurability::noneKeepsCriticalBuffered()
+{
+   quint64 syncs=QCustomLog::logFileSyncs();
+   QCustomLog::setDurability(QCustomLog::Durability::None);
+   qCCritical(lcDurability).noquote() << "critical without durability";
+   QVERIFY(!logContents().contains("critical without durability"));
+   QCOMPARE(QCustomLog::logFileSyncs(),syncs);
+
+   QCustomLog::setDurability(QCustomLog::Durability::SyncOnCritical);
+   qCCritical(lcDurability).noquote() << "critical after the mode change";
+   QByteArray contents=logContents();
+   QVERIFY(contents.contains("critical without durability"));
+   QVERIFY(contents.contains("critical after the mode change"));
+   QCOMPARE(QCustomLog::logFileSyncs(),syncs+1);
+}
+
+void TestDurability::concurrentCriticalsShareSync()
+{
+   const int threadsCount=16;
+
+   // the first flush writes a large buffer, so the other callers queue their messages behind it and are committed together
+   const QString payload(1024,QChar('x'));
+   for(int i=0;i<16*1024;i++) qCInfo(lcDurability).noquote() << payload;
+
+   quint64 syncs=QCustomLog::logFileSyncs();
+   std::atomic<bool> start{false};
+   QList<QThread*> threads;
+   for(int i=0;i<threadsCount;i++)
+   {
+      threads.append(QThread::create([&start,i]()
+      {
+         while(!start) QThread::yieldCurrentThread();
+         qCCritical(lcDurability).noquote() << "concurrent critical" << i;
+      }));
+      threads.last()->start();
+   }
+   start=true;
+   for(QThread* thread:std::as_const(threads)) { QVERIFY(thread->wait(30000)); delete thread; }
+
+   QByteArray contents=logContents();
+   for(int i=0;i<threadsCount;i++) QVERIFY(contents.contains("concurrent critical "+QByteArray::number(i)+"\n"));
+   quint64 groupSyncs=QCustomLog::logFileSyncs()-syncs;
+   QVERIFY2(groupSyncs>0 && groupSyncs<(quint64)threadsCount,qPrintable(QString::number(groupSyncs)+" syncs for "+QString::number(threadsCount)+" critical messages"));
+}
+
+QTEST_GUILESS_MAIN(TestDurability)
+#include "tst_durability.moc"
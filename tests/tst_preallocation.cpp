@@ -0,0 +1,134 @@
+/**
+ * @file tst_preallocation.cpp
+ * @brief Log files preallocation tests
+ * @details Checks that the reserved space does not change the size and the contents of the current log file,
+ *          that the reservation does not make the file look full before the maximum size is written,
+ *          and that the file is truncated to its logical end on shutdown, which releases the unused reserved space
+ * @details Shutdown is checked in a child process, the same executable with the QCUSTOMLOG_TEST_DIR environment variable
+ *
+ * @details This code is released under the MIT license
+ * @copyright (c) 2025 Dmitrii Permiakov [nebster9k]
+ *
+ * @see qcustomlog.h
+ */
+
+#include <qcustomlog.h>
+
+#include <QTest>
+#include <QTemporaryDir>
+#include <QProcess>
+
+#ifdef Q_OS_LINUX
+   #include <sys/stat.h>
+#endif
+
+Q_LOGGING_CATEGORY(lcPreallocation,"PREALLOCATION")
+
+class TestPreallocation : public QObject
+{
+   Q_OBJECT
+
+   private slots:
+      void initTestCase();
+      void reservationKeepsLogicalSize();
+      void reservedFileDoesNotRotateEarly();
+      void shutdownTruncatesToLogicalEnd();
+
+   private:
+      QByteArray fileContents(const QString& dir, const QString& fileName) const; /**< Returns the contents of a file */
+      static qint64 allocatedSize(const QString& filePath); /**< Returns the disk space allocated to a file, -1 if it is unknown */
+
+      QTemporaryDir m_dir; /**< Log files directory */
+      QString m_logDir; /**< Log files directory of this process, the one given by the parent in a child process */
+      QString m_mainLogFileName; /**< Current log file name */
+      bool m_reserved=false; /**< The file system reserves the space, so the release can be checked */
+};
+
+void TestPreallocation::initTestCase()
+{
+   QVERIFY(m_dir.isValid());
+   m_logDir=qEnvironmentVariable("QCUSTOMLOG_TEST_DIR",m_dir.path());
+   m_mainLogFileName=QCoreApplication::applicationName()+"_0.log";
+
+   QCustomLog::setMinLevels(QtMsgType::QtFatalMsg,QtMsgType::QtDebugMsg); // only the file output is checked
+   QCustomLog::setPreallocation(true);
+   QVERIFY(QCustomLog::initLogging(m_logDir,0,3,100*1024)); // buffering is disabled, so every message is in the file when the logging call returns
+}
+
+QByteArray TestPreallocation::fileContents(const QString& dir, const QString& fileName) const
+{
+   QFile file(QDir(dir).filePath(fileName));
+   if(!file.open(QFile::OpenModeFlag::ReadOnly)) return QByteArray();
+   return file.readAll();
+}
+
+qint64 TestPreallocation::allocatedSize(const QString& filePath)
+{
+   #ifdef Q_OS_LINUX
+      struct stat fileStat;
+      if(stat(QFile::encodeName(filePath).constData(),&fileStat)!=0) return -1;
+      return (qint64)fileStat.st_blocks*512;
+   #else
+      Q_UNUSED(filePath);
+      return -1;
+   #endif
+}
+
+void TestPreallocation::reservationKeepsLogicalSize()
+{
+   if(m_logDir!=m_dir.path()) QSKIP("Runs in the parent process");
+
+   qCInfo(lcPreallocation).noquote() << "first message";
+
+   // readers see only the written data, without a zero-filled tail
+   QByteArray contents=fileContents(m_logDir,m_mainLogFileName);
+   QVERIFY(contents.endsWith("[INF] [PREALLOCATION] first message\n"));
+   QVERIFY(!contents.contains('\0'));
+   QCOMPARE(QFileInfo(QDir(m_logDir).filePath(m_mainLogFileName)).size(),(qint64)contents.size());
+
+   m_reserved=(allocatedSize(QDir(m_logDir).filePath(m_mainLogFileName))>=100*1024);
+   if(!m_reserved) qWarning("The file system does not reserve the space, only the logical size is checked");
+}
+
+void TestPreallocation::reservedFileDoesNotRotateEarly()
+{
+   if(m_logDir!=m_dir.path()) QSKIP("Runs in the parent process");
+
+   const QString payload(1000,QChar('x'));
+   for(int i=0;i<50;i++) qCInfo(lcPreallocation).noquote() << "reserved message" << i << payload;
+
+   // the reservation covers the maximum file size, the tracked end is below it
+   QVERIFY(!QFileInfo::exists(QDir(m_logDir).filePath(QCoreApplication::applicationName()+"_1.log")));
+   QByteArray contents=fileContents(m_logDir,m_mainLogFileName);
+   QCOMPARE(contents.count("reserved message"),50);
+   QVERIFY(!contents.contains('\0'));
+}
+
+void TestPreallocation::shutdownTruncatesToLogicalEnd()
+{
+   // in the child process, the logging shutdown at the exit releases the reservation
+   if(m_logDir!=m_dir.path())
+   {
+      qCInfo(lcPreallocation).noquote() << "child message";
+      return;
+   }
+
+   QTemporaryDir childDir;
+   QVERIFY(childDir.isValid());
+   QProcess child;
+   QProcessEnvironment environment=QProcessEnvironment::systemEnvironment();
+   environment.insert("QCUSTOMLOG_TEST_DIR",childDir.path());
+   child.setProcessEnvironment(environment);
+   child.start(QCoreApplication::applicationFilePath(),{"shutdownTruncatesToLogicalEnd"});
+   QVERIFY(child.waitForFinished(30000));
+   QCOMPARE(child.exitStatus(),QProcess::ExitStatus::NormalExit);
+   QCOMPARE(child.exitCode(),0);
+
+   QByteArray contents=fileContents(childDir.path(),m_mainLogFileName);
+   QVERIFY(contents.endsWith("[INF] [PREALLOCATION] child message\n"));
+   QVERIFY(!contents.contains('\0'));
+   if(m_reserved) QVERIFY(allocatedSize(childDir.filePath(m_mainLogFileName))<100*1024);
+}
+
+QTEST_GUILESS_MAIN(TestPreallocation)
+#include "tst_preallocation.moc"
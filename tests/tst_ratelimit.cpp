@@ -0,0 +1,91 @@
+/**
+ * @file tst_ratelimit.cpp
+ * @brief Rate limiting tests
+ * @details Checks that token buckets pass their burst, suppress the rest of a flood, refill over time,
+ *          and that the summary of the suppressed messages is logged with the location of its bucket
+ * @details Summaries are logged at most every 5 seconds, so the test waits for that once
+ *
+ * @details This code is released under the MIT license
+ * @copyright (c) 2025 Dmitrii Permiakov [nebster9k]
+ *
+ * @see qcustomlog.h
+ */
+
+#include <qcustomlog.h>
+
+#include <QTest>
+#include <QTemporaryDir>
+
+class TestRateLimit : public QObject
+{
+   Q_OBJECT
+
+   private slots:
+      void initTestCase();
+      void floodsAreSuppressedAndSummarized();
+
+   private:
+      QByteArray logContents() const; /**< Returns the current log file contents */
+
+      QTemporaryDir m_dir; /**< Log files directory */
+};
+
+void TestRateLimit::initTestCase()
+{
+   QVERIFY(m_dir.isValid());
+   QCustomLog::setMinLevels(QtMsgType::QtFatalMsg,QtMsgType::QtDebugMsg); // only the file output is checked
+
+   // one bucket per call site, messages without a source location share the bucket of their category
+   QCustomLog::setRateLimit(0,0,QCustomLog::RateLimitKey::SourceLocation);
+   QCustomLog::setCategoryRateLimit("LIMITED",1,5);
+   QCustomLog::setCategoryRateLimit("BYSOURCE",1,5);
+   QVERIFY(QCustomLog::initLogging(m_dir.path(),0)); // buffering is disabled, so every message is in the file when the logging call returns
+}
+
+QByteArray TestRateLimit::logContents() const
+{
+   QFile logFile(m_dir.filePath(QCoreApplication::applicationName()+"_0.log"));
+   if(!logFile.open(QFile::OpenModeFlag::ReadOnly)) return QByteArray();
+   return logFile.readAll();
+}
+
+void TestRateLimit::floodsAreSuppressedAndSummarized()
+{
+   // the source location is set explicitly, so it does not depend on QT_MESSAGELOGCONTEXT
+   auto logAt=[](const char* file, int line, const char* category, const char* text) { QMessageLogger(file,line,nullptr,category).info().noquote() << text; };
+
+   // a flood of one token per second lasts a few milliseconds, so only the burst passes
+   for(int i=0;i<20;i++)
+   {
+      logAt(nullptr,0,"LIMITED","category flood");
+      logAt(__FILE__,1001,"BYSOURCE","first site flood");
+      logAt(__FILE__,1002,"BYSOURCE","second site flood");
+   }
+   for(int i=0;i<3;i++) QMessageLogger(nullptr,0,nullptr,"LIMITED").critical().noquote() << "critical during the flood";
+
+   QByteArray contents=logContents();
+   QCOMPARE(contents.count("category flood"),5);
+   QCOMPARE(contents.count("first site flood"),5);
+   QCOMPARE(contents.count("second site flood"),5);
+   QCOMPARE(contents.count("critical during the flood"),3); // critical messages are never limited
+   QVERIFY(!contents.contains("Suppressed"));
+
+   // the buckets refill, and the next allowed message is preceded by the summary of its bucket, other buckets are summarized with it
+   QTest::qSleep(5200);
+   logAt(nullptr,0,"LIMITED","category after the flood");
+   logAt(__FILE__,1001,"BYSOURCE","first site after the flood");
+   logAt(__FILE__,1002,"BYSOURCE","second site after the flood");
+
+   contents=logContents();
+   qsizetype categorySummary=contents.indexOf("[WRN] [LIMITED] Suppressed 15 similar messages\n");
+   QVERIFY(categorySummary>=0);
+   QVERIFY(categorySummary<contents.indexOf("category after the flood"));
+   QVERIFY(contents.contains("[WRN] [BYSOURCE] Suppressed 15 similar messages from tst_ratelimit.cpp:1001\n"));
+   QVERIFY(contents.contains("[WRN] [BYSOURCE] Suppressed 15 similar messages from tst_ratelimit.cpp:1002\n"));
+   QVERIFY(contents.contains("first site after the flood"));
+   QVERIFY(contents.contains("second site after the flood"));
+   QCOMPARE(contents.count("Suppressed"),3);
+}
+
+QTEST_GUILESS_MAIN(TestRateLimit)
+#include "tst_ratelimit.moc"
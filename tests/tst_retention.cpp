@@ -0,0 +1,110 @@
+/**
+ * @file tst_retention.cpp
+ * @brief Log files retention tests
+ * @details Checks that the files retired by a previous process and the files older than the maximum age are removed on start,
+ *          that the oldest files are removed once the written bytes exceed the total size budget, and that the tracked size follows the directory
+ *
+ * @details This code is released under the MIT license
+ * @copyright (c) 2025 Dmitrii Permiakov [nebster9k]
+ *
+ * @see qcustomlog.h
+ */
+
+#include <qcustomlog.h>
+
+#include <QTest>
+#include <QTemporaryDir>
+
+Q_LOGGING_CATEGORY(lcRetention,"RETENTION")
+
+class TestRetention : public QObject
+{
+   Q_OBJECT
+
+   private slots:
+      void initTestCase();
+      void staleAndExpiredFilesAreRemoved();
+      void sizeBudgetRemovesOldestFiles();
+
+   private:
+      QString fileName(int index) const { return QCoreApplication::applicationName()+"_"+QString::number(index)+".log"; } /**< Returns the name of a numbered log file */
+      bool exists(const QString& fileName) const { return QFileInfo::exists(m_dir.filePath(fileName)); } /**< Checks that a file of the directory exists */
+      bool writeFile(const QString& fileName, const QByteArray& contents, qint64 ageMs); /**< Creates a file of the directory with the contents and the last write time in the past */
+      quint64 directorySize() const; /**< Returns the total size of the log files of the directory */
+      bool retiredFilesLeft() const; /**< Checks that the directory has files with the .retired suffix */
+
+      QTemporaryDir m_dir; /**< Log files directory */
+};
+
+void TestRetention::initTestCase()
+{
+   QVERIFY(m_dir.isValid());
+
+   // files of a previous run, the current file is continued, the oldest one is expired, one file was retired but not deleted
+   QVERIFY(writeFile(fileName(0),"previous run\n",0));
+   QVERIFY(writeFile(fileName(1),QByteArray(40*1024,'1'),2*60*1000));
+   QVERIFY(writeFile(fileName(2),QByteArray(40*1024,'2'),60*60*1000));
+   QVERIFY(writeFile(fileName(3),QByteArray(40*1024,'3'),10*24*60*60*1000ll));
+   QVERIFY(writeFile(fileName(4)+".retired",QByteArray(40*1024,'4'),10*24*60*60*1000ll));
+
+   QCustomLog::setMinLevels(QtMsgType::QtFatalMsg,QtMsgType::QtDebugMsg); // only the file output is checked
+   QCustomLog::setRetention(150*1024,24*60*60*1000);
+   QVERIFY(QCustomLog::initLogging(m_dir.path(),0,10,100*1024)); // buffering is disabled, so every message is in the file when the logging call returns
+}
+
+bool TestRetention::writeFile(const QString& fileName, const QByteArray& contents, qint64 ageMs)
+{
+   QFile file(m_dir.filePath(fileName));
+   if(!file.open(QFile::OpenModeFlag::WriteOnly|QFile::OpenModeFlag::Truncate)) return false;
+   if(file.write(contents)!=contents.size() || !file.flush()) return false;
+   return file.setFileTime(QDateTime::currentDateTime().addMSecs(-ageMs),QFileDevice::FileTime::FileModificationTime);
+}
+
+quint64 TestRetention::directorySize() const
+{
+   quint64 size=0;
+   for(const QFileInfo& fileInfo:QDir(m_dir.path()).entryInfoList({QCoreApplication::applicationName()+"_*.log"},QDir::Files)) size+=fileInfo.size();
+   return size;
+}
+
+bool TestRetention::retiredFilesLeft() const
+{
+   return !QDir(m_dir.path()).entryList({"*.retired"},QDir::Files).isEmpty();
+}
+
+void TestRetention::staleAndExpiredFilesAreRemoved()
+{
+   QTRY_VERIFY(!exists(fileName(3)));
+   QTRY_VERIFY(!retiredFilesLeft());
+
+   // the files within the age and the budget are kept without renaming
+   QVERIFY(exists(fileName(0)));
+   QVERIFY(exists(fileName(1)));
+   QVERIFY(exists(fileName(2)));
+   QCOMPARE(QCustomLog::logFilesSize(),directorySize());
+}
+
+void TestRetention::sizeBudgetRemovesOldestFiles()
+{
+   // under the budget nothing is removed
+   const QString payload(1000,QChar('x'));
+   for(int i=0;i<50;i++) qCInfo(lcRetention).noquote() << "budget message" << i << payload;
+   QTest::qWait(200);
+   QVERIFY(exists(fileName(2)));
+   QCOMPARE(QCustomLog::logFilesSize(),directorySize());
+
+   // over the budget the least recently written file is removed, the current file stays below the maximum size, so there is no rotation
+   for(int i=50;i<80;i++) qCInfo(lcRetention).noquote() << "budget message" << i << payload;
+   QTRY_VERIFY(!exists(fileName(2)));
+   QTRY_VERIFY(!retiredFilesLeft());
+   QVERIFY(exists(fileName(1)));
+   QVERIFY(QCustomLog::logFilesSize()<=150*1024);
+   QCOMPARE(QCustomLog::logFilesSize(),directorySize());
+
+   QFile logFile(m_dir.filePath(fileName(0)));
+   QVERIFY(logFile.open(QFile::OpenModeFlag::ReadOnly));
+   QCOMPARE(logFile.readAll().count("budget message"),80);
+}
+
+QTEST_GUILESS_MAIN(TestRetention)
+#include "tst_retention.moc"
@@ -0,0 +1,107 @@
+/**
+ * @file tst_rotationperiod.cpp
+ * @brief Time-based log rotation tests
+ * @details Checks the names of hourly or daily log files, that the last segment of the current period is continued after a restart,
+ *          that a full segment continues in the next one without renaming files, and that the oldest periods are removed first
+ * @details Hourly rotation is tested by default, daily rotation if the QCUSTOMLOG_TEST_PERIOD environment variable is "daily"
+ *
+ * @details This code is released under the MIT license
+ * @copyright (c) 2025 Dmitrii Permiakov [nebster9k]
+ *
+ * @see qcustomlog.h
+ */
+
+#include <qcustomlog.h>
+
+#include <QTest>
+#include <QTemporaryDir>
+
+Q_LOGGING_CATEGORY(lcRotation,"ROTATION")
+
+class TestRotationPeriod : public QObject
+{
+   Q_OBJECT
+
+   private slots:
+      void initTestCase();
+      void lastSegmentIsContinued();
+      void fullSegmentContinuesInNextOne();
+
+   private:
+      QString fileName(const QString& stamp, int segment) const { return QCoreApplication::applicationName()+"-"+stamp+"."+QString::number(segment)+".log"; } /**< Returns the name of a log file segment */
+      QByteArray fileContents(const QString& fileName) const; /**< Returns the contents of a file of the directory */
+      bool writeFile(const QString& fileName, const QByteArray& contents); /**< Creates a file of the directory with the contents */
+
+      QTemporaryDir m_dir; /**< Log files directory */
+      QString m_stamp; /**< Current period in UTC */
+      QString m_oldStamp; /**< Period of the previous files */
+};
+
+void TestRotationPeriod::initTestCase()
+{
+   QVERIFY(m_dir.isValid());
+
+   bool daily=(qgetenv("QCUSTOMLOG_TEST_PERIOD")=="daily");
+   const QString format=daily ? "yyyy-MM-dd" : "yyyy-MM-dd-HH";
+   m_stamp=QDateTime::currentDateTimeUtc().toString(format);
+   m_oldStamp=daily ? "2000-01-01" : "2000-01-01-00";
+
+   // files of a previous run, a full and a continued segment of the current period, and two segments of an old period
+   QVERIFY(writeFile(fileName(m_stamp,0),QByteArray(100*1024,'#')));
+   QVERIFY(writeFile(fileName(m_stamp,1),"previous run\n"));
+   QVERIFY(writeFile(fileName(m_oldStamp,2),"old segment 2\n"));
+   QVERIFY(writeFile(fileName(m_oldStamp,10),"old segment 10\n"));
+
+   QCustomLog::setMinLevels(QtMsgType::QtFatalMsg,QtMsgType::QtDebugMsg); // only the file output is checked
+   QCustomLog::setUtcMode(true);
+   QCustomLog::setRotationPeriod(daily ? QCustomLog::RotationPeriod::Daily : QCustomLog::RotationPeriod::Hourly);
+   QVERIFY(QCustomLog::initLogging(m_dir.path(),0,4,100*1024)); // buffering is disabled, so every message is in the file when the logging call returns
+
+   if(QDateTime::currentDateTimeUtc().toString(format)!=m_stamp) QSKIP("The period ended during the start");
+}
+
+QByteArray TestRotationPeriod::fileContents(const QString& fileName) const
+{
+   QFile file(m_dir.filePath(fileName));
+   if(!file.open(QFile::OpenModeFlag::ReadOnly)) return QByteArray();
+   return file.readAll();
+}
+
+bool TestRotationPeriod::writeFile(const QString& fileName, const QByteArray& contents)
+{
+   QFile file(m_dir.filePath(fileName));
+   if(!file.open(QFile::OpenModeFlag::WriteOnly|QFile::OpenModeFlag::Truncate)) return false;
+   return file.write(contents)==contents.size();
+}
+
+void TestRotationPeriod::lastSegmentIsContinued()
+{
+   qCInfo(lcRotation).noquote() << "continued message";
+
+   QByteArray contents=fileContents(fileName(m_stamp,1));
+   QVERIFY(contents.startsWith("previous run\n"));
+   QVERIFY(contents.contains("[INF] [ROTATION] continued message\n"));
+   QVERIFY(!fileContents(fileName(m_stamp,0)).contains("continued message"));
+}
+
+void TestRotationPeriod::fullSegmentContinuesInNextOne()
+{
+   const QString payload(1024,QChar('x'));
+   for(int i=0;i<120;i++) qCInfo(lcRotation).noquote() << "segment message" << i << payload;
+
+   // the full segment keeps its name, the next message opens the next segment
+   QByteArray continued=fileContents(fileName(m_stamp,1)), next=fileContents(fileName(m_stamp,2));
+   QVERIFY(continued.startsWith("previous run\n"));
+   QVERIFY(continued.size()>=100*1024);
+   QVERIFY(continued.contains("segment message 0 "));
+   QVERIFY(next.contains("segment message 119 "));
+   QCOMPARE(continued.count("segment message")+next.count("segment message"),120);
+   QVERIFY(QFileInfo::exists(m_dir.filePath(fileName(m_stamp,0))));
+
+   // segments are ordered numerically, so the segment 2 of the old period is removed before its segment 10
+   QStringList files=QDir(m_dir.path()).entryList({QCoreApplication::applicationName()+"-*.log"},QDir::Files,QDir::Name);
+   QCOMPARE(files,QStringList({fileName(m_oldStamp,10),fileName(m_stamp,0),fileName(m_stamp,1),fileName(m_stamp,2)}));
+}
+
+QTEST_GUILESS_MAIN(TestRotationPeriod)
+#include "tst_rotationperiod.moc"
@@ -0,0 +1,154 @@
+/**
+ * @file tst_routing.cpp
+ * @brief Sampling and sink routing tests
+ * @details Checks that sampling keeps the configured fraction of debug and information messages per category,
+ *          and that the cached route bitmasks follow the sink filters, their changes and the removal of sinks up to the 63 sinks limit
+ *
+ * @details This code is released under the MIT license
+ * @copyright (c) 2025 Dmitrii Permiakov [nebster9k]
+ *
+ * @see qcustomlog.h
+ */
+
+#include <qcustomlog.h>
+
+#include <QTest>
+#include <QTemporaryDir>
+
+Q_LOGGING_CATEGORY(lcSampled,"SAMPLED")
+Q_LOGGING_CATEGORY(lcDropped,"DROPPED")
+Q_LOGGING_CATEGORY(lcDefaulted,"DEFAULTED")
+Q_LOGGING_CATEGORY(lcNet,"NET")
+Q_LOGGING_CATEGORY(lcDb,"DB")
+Q_LOGGING_CATEGORY(lcFlush,"FLUSH")
+
+class RecordingSink : public QCustomLogSink
+{
+   public:
+      explicit RecordingSink(quint32 queueSize=8192) : QCustomLogSink(queueSize) {}
+
+      QStringList messages; /**< Received messages, read after the sink is removed */
+
+   protected:
+      void writeRecords(const QList<QCustomLogRecord>& records) override { for(const QCustomLogRecord& record:records) messages.append(record.message); }
+};
+
+class TestRouting : public QObject
+{
+   Q_OBJECT
+
+   private slots:
+      void initTestCase();
+      void samplingKeepsFraction();
+      void routesFollowSinkFilters();
+      void routesCoverSinksLimit();
+
+   private:
+      QByteArray flushedContents() const; /**< Flushes the buffer with a critical message and returns the log file contents */
+
+      QTemporaryDir m_dir; /**< Log files directory */
+};
+
+void TestRouting::initTestCase()
+{
+   QVERIFY(m_dir.isValid());
+   QCustomLog::setMinLevels(QtMsgType::QtFatalMsg,QtMsgType::QtDebugMsg); // only the file output and the sinks are checked
+   QVERIFY(QCustomLog::initLogging(m_dir.path(),10000)); // buffered, the timer never fires without an event loop
+}
+
+QByteArray TestRouting::flushedContents() const
+{
+   qCCritical(lcFlush).noquote() << "flush";
+   QFile logFile(m_dir.filePath(QCoreApplication::applicationName()+"_0.log"));
+   if(!logFile.open(QFile::OpenModeFlag::ReadOnly)) return QByteArray();
+   return logFile.readAll();
+}
+
+void TestRouting::samplingKeepsFraction()
+{
+   QCustomLog::setSampling("SAMPLED",0.1);
+   QCustomLog::setSampling("DROPPED",0.0);
+   QCustomLog::setSampling(QString(),0.5);
+
+   QHash<QString,double> rates=QCustomLog::samplingRates();
+   QCOMPARE(rates.value("SAMPLED"),0.1);
+   QCOMPARE(rates.value("DROPPED"),0.0);
+   QCOMPARE(rates.value(QString()),0.5);
+
+   for(int i=0;i<20000;i++) qCInfo(lcSampled).noquote() << "sampled info";
+   for(int i=0;i<1000;i++) qCInfo(lcDropped).noquote() << "dropped info";
+   for(int i=0;i<4000;i++) qCInfo(lcDefaulted).noquote() << "defaulted info";
+   for(int i=0;i<100;i++) qCWarning(lcSampled).noquote() << "sampled warning";
+
+   // the bounds are more than 6 standard deviations away from the expected counts
+   QByteArray contents=flushedContents();
+   int sampled=(int)contents.count("sampled info"), defaulted=(int)contents.count("defaulted info");
+   QVERIFY2(sampled>1700 && sampled<2300,qPrintable(QString::number(sampled)+" of 20000 kept at 0.1"));
+   QVERIFY2(defaulted>1800 && defaulted<2200,qPrintable(QString::number(defaulted)+" of 4000 kept at the default 0.5"));
+   QCOMPARE(contents.count("dropped info"),0);
+   QCOMPARE(contents.count("sampled warning"),100); // warnings are never sampled
+
+   // the rate 1.0 removes the sampling
+   QCustomLog::setSampling("SAMPLED",1.0);
+   QCustomLog::setSampling("DROPPED",1.0);
+   QCustomLog::setSampling(QString(),1.0);
+   QCOMPARE(QCustomLog::samplingRates().count(),1);
+   for(int i=0;i<100;i++) qCInfo(lcDropped).noquote() << "dropped again";
+   QCOMPARE(flushedContents().count("dropped again"),100);
+}
+
+void TestRouting::routesFollowSinkFilters()
+{
+   RecordingSink netSink, warningSink;
+   netSink.setFilter(QtMsgType::QtDebugMsg,{"NET"});
+   warningSink.setFilter(QtMsgType::QtWarningMsg);
+   QVERIFY(QCustomLog::addSink(&netSink));
+   QVERIFY(QCustomLog::addSink(&warningSink));
+   QCustomLog::fileSink()->setFilter(QtMsgType::QtWarningMsg);
+
+   qCInfo(lcNet).noquote() << "net info";
+   qCWarning(lcNet).noquote() << "net warning";
+   qCInfo(lcDb).noquote() << "db info";
+   qCWarning(lcDb).noquote() << "db warning";
+
+   // routes are recomputed after a filter change and after a removal, which shifts the bits of the following sinks
+   warningSink.setFilter(QtMsgType::QtCriticalMsg);
+   qCWarning(lcDb).noquote() << "db warning after the filter change";
+   QCustomLog::removeSink(&netSink);
+   qCCritical(lcDb).noquote() << "db critical after the removal";
+   QCustomLog::removeSink(&warningSink);
+   QCustomLog::fileSink()->setFilter(QtMsgType::QtDebugMsg);
+
+   QCOMPARE(netSink.messages,QStringList({"net info","net warning"}));
+   QCOMPARE(warningSink.messages,QStringList({"net warning","db warning","db critical after the removal"}));
+
+   QByteArray contents=flushedContents();
+   QVERIFY(!contents.contains("net info"));
+   QVERIFY(!contents.contains("db info"));
+   QVERIFY(contents.contains("net warning"));
+   QVERIFY(contents.contains("db warning after the filter change"));
+   QVERIFY(contents.contains("db critical after the removal"));
+}
+
+void TestRouting::routesCoverSinksLimit()
+{
+   // the file sink and 63 sinks fill the 64-bit route
+   QList<RecordingSink*> sinks;
+   for(int i=0;i<63;i++) { sinks.append(new RecordingSink(16)); QVERIFY(QCustomLog::addSink(sinks.last())); }
+   RecordingSink extraSink(16);
+   QVERIFY(!QCustomLog::addSink(&extraSink));
+   QVERIFY(QCustomLog::addSink(sinks.first())); // already added
+
+   sinks.last()->setFilter(QtMsgType::QtWarningMsg);
+   qCInfo(lcNet).noquote() << "info to all sinks but the last";
+   qCWarning(lcNet).noquote() << "warning to all sinks";
+
+   for(RecordingSink* sink:std::as_const(sinks)) QCustomLog::removeSink(sink);
+   QCOMPARE(sinks.first()->messages,QStringList({"info to all sinks but the last","warning to all sinks"}));
+   QCOMPARE(sinks.last()->messages,QStringList({"warning to all sinks"}));
+   QVERIFY(extraSink.messages.isEmpty());
+   qDeleteAll(sinks);
+}
+
+QTEST_GUILESS_MAIN(TestRouting)
+#include "tst_routing.moc"
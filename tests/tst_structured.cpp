@@ -0,0 +1,147 @@
+/**
+ * @file tst_structured.cpp
+ * @brief Structured logging tests
+ * @details Checks the text, JSON and binary serialization of typed fields,
+ *          and that a structured message reaches the JSON Lines file, the overrided sendLog() and the asynchronous sinks
+ *
+ * @details This code is released under the MIT license
+ * @copyright (c) 2025 Dmitrii Permiakov [nebster9k]
+ *
+ * @see qcustomlog.h
+ */
+
+#include <qcustomlog.h>
+
+#include <QTest>
+#include <QTemporaryDir>
+
+class RecordingSink : public QCustomLogSink
+{
+   public:
+      QList<QCustomLogRecord> records; /**< Received records, read after the sink is removed */
+
+   protected:
+      void writeRecords(const QList<QCustomLogRecord>& batch) override { records.append(batch); }
+};
+
+class RecordingLog : public QCustomLog
+{
+   public:
+      QStringList messages; /**< Messages of the DB category passed to sendLog() */
+
+   protected:
+      void sendLog(const QDateTime& time, const QtMsgType type, const QString& category, const QString& msg) override
+      {
+         Q_UNUSED(time); Q_UNUSED(type);
+         if(category=="DB") messages.append(msg);
+      }
+};
+
+class TestStructured : public QObject
+{
+   Q_OBJECT
+
+   private slots:
+      void initTestCase();
+      void textSerialization();
+      void jsonSerialization();
+      void binarySerialization();
+      void structuredMessageOutputs();
+      void cleanupTestCase();
+
+   private:
+      QByteArray logContents() const; /**< Returns the current log file contents */
+
+      QTemporaryDir m_dir; /**< Log files directory */
+      RecordingLog m_log; /**< Custom instance receiving the text form */
+};
+
+void TestStructured::initTestCase()
+{
+   QVERIFY(m_dir.isValid());
+   QCustomLog::setMinLevels(QtMsgType::QtFatalMsg,QtMsgType::QtDebugMsg); // only the file, the instance and the sink are checked
+   QCustomLog::setFileFormat(QCustomLog::FileFormat::JsonLines);
+   QCustomLog::setInstance(&m_log);
+   QVERIFY(QCustomLog::initLogging(m_dir.path(),0)); // buffering is disabled, so every message is in the file when the logging call returns
+}
+
+QByteArray TestStructured::logContents() const
+{
+   QFile logFile(m_dir.filePath(QCoreApplication::applicationName()+"_0.log"));
+   if(!logFile.open(QFile::OpenModeFlag::ReadOnly)) return QByteArray();
+   return logFile.readAll();
+}
+
+void TestStructured::textSerialization()
+{
+   QString text;
+   QCustomLogField::appendText(text,{{"ms",12},{"rows",3u},{"ratio",0.5},{"ok",true},{"table","users"},{"note","two words"},{"quote","a\"b"},{"empty",""}});
+   QCOMPARE(text,QString("ms=12 rows=3 ratio=0.5 ok=true table=users note=\"two words\" quote=\"a\\\"b\" empty=\"\""));
+
+   // a prefix is separated by a space
+   QString message("query done");
+   QCustomLogField::appendText(message,{{"ms",-1}});
+   QCOMPARE(message,QString("query done ms=-1"));
+}
+
+void TestStructured::jsonSerialization()
+{
+   QByteArray json;
+   QCustomLogField::appendJson(json,{{"ms",12},{"rows",3u},{"ratio",0.5},{"ok",false},{"table","users"},{"note","line\nbreak \"quoted\""},{"inf",qInf()}});
+   QCOMPARE(json,QByteArray(",\"ms\":12,\"rows\":3,\"ratio\":0.5,\"ok\":false,\"table\":\"users\",\"note\":\"line\\nbreak \\\"quoted\\\"\",\"inf\":null"));
+
+   // non-ASCII text is valid JSON as UTF-8, control characters are escaped
+   json.clear();
+   QCustomLogField::appendJson(json,{{"name",QString::fromUtf8("\xC3\xA9t\xC3\xA9")},{"bell",QString(QChar(7))}});
+   QCOMPARE(json,QByteArray(",\"name\":\"\xC3\xA9t\xC3\xA9\",\"bell\":\"\\u0007\""));
+}
+
+void TestStructured::binarySerialization()
+{
+   QByteArray binary;
+   QCustomLogField::appendBinary(binary,{{"n",-2},{"s","ab"}});
+
+   QByteArray expected("\x02\x00",2); // fields count
+   expected.append("\x01n",2).append((char)QCustomLogField::Type::Int).append("\xFE\xFF\xFF\xFF\xFF\xFF\xFF\xFF",8);
+   expected.append("\x01s",2).append((char)QCustomLogField::Type::String).append("\x02\x00\x00\x00",4).append("ab");
+   QCOMPARE(binary,expected);
+}
+
+void TestStructured::structuredMessageOutputs()
+{
+   RecordingSink sink;
+   QVERIFY(QCustomLog::addSink(&sink));
+   logInfoKV("DB","query done",{"ms",12},{"rows",3},{"table","users"});
+   QCustomLog::removeSink(&sink); // the worker writes all queued records before it stops
+
+   // typed members of the JSON line follow the message
+   QByteArray contents=logContents();
+   QVERIFY(contents.contains("\"level\":\"info\",\"category\":\"DB\""));
+   QVERIFY(contents.contains("\"message\":\"query done\",\"ms\":12,\"rows\":3,\"table\":\"users\"}\n"));
+
+   // sendLog() gets the fields as text
+   QCOMPARE(m_log.messages,QStringList({"query done ms=12 rows=3 table=users"}));
+
+   // sinks get the message without the fields and the fields typed
+   QCOMPARE(sink.records.count(),1);
+   const QCustomLogRecord& record=sink.records.first();
+   QCOMPARE(record.category,QString("DB"));
+   QCOMPARE(record.message,QString("query done"));
+   QCOMPARE(record.fields.count(),3);
+   QVERIFY(record.fields.at(0).type==QCustomLogField::Type::Int);
+   QCOMPARE(record.fields.at(0).intValue,(qint64)12);
+   QVERIFY(record.fields.at(2).type==QCustomLogField::Type::String);
+   QCOMPARE(record.fields.at(2).stringValue,QString("users"));
+
+   // the fields are scoped to the structured message
+   qInfo(QLoggingCategory("DB")).noquote() << "plain message";
+   QCOMPARE(m_log.messages.last(),QString("plain message"));
+}
+
+void TestStructured::cleanupTestCase()
+{
+   QCustomLog::setInstance(nullptr);
+}
+
+QTEST_GUILESS_MAIN(TestStructured)
+#include "tst_structured.moc"